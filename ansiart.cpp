@@ -0,0 +1,1003 @@
+#include "door.h"
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+// mmap
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @file
+ * @brief ANSI art (.ANS) decoder and file viewer
+ */
+
+namespace door {
+
+MappedFile::MappedFile() : start{nullptr}, length{0} {}
+
+MappedFile::~MappedFile() { close(); }
+
+/**
+ * Map the file into memory (read-only).
+ *
+ * @param filename
+ * @return true on success
+ */
+bool MappedFile::open(const char *filename) {
+  close();
+
+  int fd = ::open(filename, O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+  if ((fstat(fd, &st) == -1) or (st.st_size == 0)) {
+    ::close(fd);
+    return false;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED)
+    return false;
+
+  start = (const char *)addr;
+  length = st.st_size;
+  return true;
+}
+
+void MappedFile::close(void) {
+  if (start != nullptr) {
+    munmap((void *)start, length);
+    start = nullptr;
+    length = 0;
+  }
+}
+
+/**
+ * @brief CP437 0x00-0x1f and 0x7f as unicode symbols.
+ *
+ * In ANSI art, these are drawn as symbols (not control codes).
+ */
+static const char *CP437_LOW[32] = {
+    " ", "\u263a", "\u263b", "\u2665", "\u2666", "\u2663",
+    "\u2660", "\u2022", "\u25d8", "\u25cb", "\u25d9", "\u2642",
+    "\u2640", "\u266a", "\u266b", "\u263c", "\u25ba", "\u25c4",
+    "\u2195", "\u203c", "\u00b6", "\u00a7", "\u25ac", "\u21a8",
+    "\u2191", "\u2193", "\u2192", "\u2190", "\u221f", "\u2194",
+    "\u25b2", "\u25bc"};
+
+/**
+ * @brief CP437 to UTF-8, one entry per character.
+ */
+struct cp437_table {
+  std::string utf8[256];
+
+  cp437_table() {
+    char ch[2] = {0, 0};
+    for (int c = 0; c < 256; ++c) {
+      if (c < 0x20)
+        utf8[c] = CP437_LOW[c];
+      else if (c == 0x7f)
+        utf8[c] = "\u2302";
+      else if (c < 0x80)
+        utf8[c] = std::string(1, (char)c);
+      else {
+        ch[0] = (char)c;
+        cp437toUnicode(ch, utf8[c]);
+      }
+    }
+  }
+};
+
+static const std::string &cp437_utf8(unsigned char c) {
+  static const cp437_table table;
+  return table.utf8[c];
+}
+
+/**
+ * @brief Apply SGR parameters.
+ *
+ * No parameters is a reset.  256 and 24 bit colors are quantized.
+ *
+ * @param params
+ * @param count
+ * @param ice bright backgrounds (100-107) set blink
+ */
+void SGRState::apply(const int *params, int count, bool ice) {
+  if (count == 0) {
+    *this = SGRState();
+    return;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    int p = params[i];
+    if (p == 0) {
+      *this = SGRState();
+    } else if (p == 1) {
+      bold = true;
+    } else if (p == 5) {
+      blink = true;
+    } else if (p == 7) {
+      inverse = true;
+    } else if (p == 22) {
+      bold = false;
+    } else if (p == 25) {
+      blink = false;
+    } else if (p == 27) {
+      inverse = false;
+    } else if ((p >= 30) and (p <= 37)) {
+      fg = p - 30;
+    } else if (p == 39) {
+      fg = (int)COLOR::WHITE;
+    } else if ((p >= 40) and (p <= 47)) {
+      bg = p - 40;
+    } else if (p == 49) {
+      bg = (int)COLOR::BLACK;
+    } else if ((p >= 90) and (p <= 97)) {
+      fg = p - 90 + 8;
+    } else if ((p >= 100) and (p <= 107)) {
+      // bright background, only with iCE colors
+      bg = p - 100;
+      if (ice)
+        blink = true;
+    } else if ((p == 38) or (p == 48)) {
+      XColor xc;
+      if ((i + 2 < count) and (params[i + 1] == 5)) {
+        xc = XColor((std::uint8_t)params[i + 2]);
+        i += 2;
+      } else if ((i + 4 < count) and (params[i + 1] == 2)) {
+        xc = XColor(params[i + 2], params[i + 3], params[i + 4]);
+        i += 4;
+      } else {
+        break;
+      }
+      if (p == 38)
+        fg = xc.fg16();
+      else
+        bg = xc.bg8();
+    }
+  }
+}
+
+PackedColor SGRState::color(void) const {
+  COLOR f = (COLOR)(fg & 0x07);
+  COLOR b = (COLOR)bg;
+  if (inverse)
+    return PackedColor(b, f, bold or (fg & 0x08), blink);
+  return PackedColor(f, b, bold or (fg & 0x08), blink);
+}
+
+/// A blank cell, white on black space.
+static const ANSIArt::Cell BLANK = {' ',
+                                    PackedColor(COLOR::WHITE, COLOR::BLACK)};
+
+ANSIArt::ANSIArt()
+    : x{1}, y{1}, width{80}, height{0}, ice{false}, skip_blanks{true} {}
+
+/**
+ * @brief Set the screen position to display the art at.
+ *
+ * @param[in] xp,yp screen position
+ */
+void ANSIArt::set(int xp, int yp) {
+  x = xp;
+  y = yp;
+}
+
+/**
+ * Remove all cells.  Width and iCE colors are kept.
+ */
+void ANSIArt::clear(void) {
+  cells.clear();
+  height = 0;
+}
+
+/// Largest CSI parameter kept, larger values are clamped
+static const int CSI_PARAM_MAX = 9999;
+/// Largest ANSI art height, rows past it are drawn on the last row
+static const int ART_MAX_ROWS = 9999;
+/// Largest SAUCE width used
+static const int ART_MAX_WIDTH = 1024;
+
+/**
+ * @brief Add a digit to a CSI parameter, clamped to CSI_PARAM_MAX.
+ *
+ * @param param
+ * @param c digit
+ * @return int
+ */
+static int csiDigit(int param, char c) {
+  return std::min(param * 10 + (c - '0'), CSI_PARAM_MAX);
+}
+
+/**
+ * @brief Read the SAUCE record, if there is one.
+ *
+ * For character data, it gives the width (TInfo1) and iCE colors
+ * (TFlags).  Otherwise width and ice are left alone.
+ *
+ * @param file
+ * @param[out] width
+ * @param[out] ice
+ * @return length of the file without the SAUCE record
+ */
+static std::size_t readSauce(const MappedFile &file, int &width, bool &ice) {
+  const unsigned char *data = (const unsigned char *)file.data();
+  std::size_t length = file.size();
+
+  if ((length >= 128) and
+      (memcmp(data + length - 128, "SAUCE00", 7) == 0)) {
+    const unsigned char *sauce = data + length - 128;
+    int data_type = sauce[94];
+    int tinfo1 = sauce[96] | (sauce[97] << 8);
+    int flags = sauce[105];
+
+    // Character data (ASCII, ANSi, ANSiMation)
+    if (data_type == 1) {
+      if (tinfo1 > 0)
+        width = std::min(tinfo1, ART_MAX_WIDTH);
+      ice = (flags & 0x01) != 0;
+    }
+    length -= 128;
+  }
+  return length;
+}
+
+/**
+ * Load and decode an ANSI art file.
+ *
+ * The file is memory mapped and decoded in one pass.  If there is a
+ * SAUCE record, it gives the width (TInfo1) and iCE colors (TFlags).
+ *
+ * @param filename
+ * @return true if the file was loaded
+ */
+bool ANSIArt::load(const char *filename) {
+  MappedFile file;
+  if (!file.open(filename))
+    return false;
+
+  width = 80;
+  ice = false;
+  std::size_t length = readSauce(file, width, ice);
+
+  clear();
+  decode(file.data(), length);
+  return true;
+}
+
+/**
+ * Decode ANSI art into cells.
+ *
+ * This handles text, CR/LF/TAB, SGR colors (including 256 and 24 bit
+ * colors, which are quantized), cursor movement, save/restore, clear
+ * screen and erase line.  Decoding stops at EOF (^Z).
+ *
+ * @param data
+ * @param length
+ */
+void ANSIArt::decode(const char *data, std::size_t length) {
+  enum { TEXT, ESCAPE, CONTROL } state = TEXT;
+  int params[16];
+  int count = 0;
+  bool private_mode = false;
+
+  int col = 0;
+  int row = 0;
+  int saved_col = 0;
+  int saved_row = 0;
+
+  SGRState pen;
+  PackedColor color(COLOR::WHITE, COLOR::BLACK);
+
+  auto grow = [&](int r) {
+    if (r >= height) {
+      height = r + 1;
+      cells.resize(height * width, BLANK);
+    }
+  };
+
+  // Hostile files can't make the art huge.
+  auto limit = [&](void) {
+    if (row >= ART_MAX_ROWS)
+      row = ART_MAX_ROWS - 1;
+  };
+
+  auto put = [&](unsigned char ch) {
+    if (col >= width) {
+      col = 0;
+      ++row;
+      limit();
+    }
+    grow(row);
+    cells[row * width + col] = {ch, color};
+    ++col;
+  };
+
+  auto param = [&](int i, int def) {
+    return ((i < count) and (params[i] > 0)) ? params[i] : def;
+  };
+
+  auto control = [&](char command) {
+    if (private_mode)
+      return;
+
+    switch (command) {
+    case 'A':
+      row -= param(0, 1);
+      if (row < 0)
+        row = 0;
+      break;
+    case 'B':
+      row += param(0, 1);
+      limit();
+      break;
+    case 'C':
+      col += param(0, 1);
+      if (col >= width)
+        col = width - 1;
+      break;
+    case 'D':
+      col -= param(0, 1);
+      if (col < 0)
+        col = 0;
+      break;
+    case 'H':
+    case 'f':
+      row = param(0, 1) - 1;
+      limit();
+      col = param(1, 1) - 1;
+      if (col >= width)
+        col = width - 1;
+      break;
+    case 'J':
+      if (param(0, 0) == 2) {
+        clear();
+        row = col = 0;
+      }
+      break;
+    case 'K':
+      grow(row);
+      for (int c = col; c < width; ++c)
+        cells[row * width + c] = {' ', color};
+      break;
+    case 's':
+      saved_col = col;
+      saved_row = row;
+      break;
+    case 'u':
+      col = saved_col;
+      row = saved_row;
+      break;
+    case 'm':
+      pen.apply(params, count, ice);
+      color = pen.color();
+      break;
+    }
+  };
+
+  const unsigned char *cp = (const unsigned char *)data;
+  const unsigned char *end = cp + length;
+
+  for (; cp < end; ++cp) {
+    unsigned char c = *cp;
+
+    switch (state) {
+    case TEXT:
+      switch (c) {
+      case 0x1a:
+        // EOF, SAUCE follows
+        return;
+      case 0x1b:
+        state = ESCAPE;
+        break;
+      case '\r':
+        col = 0;
+        break;
+      case '\n':
+        ++row;
+        limit();
+        col = 0;
+        break;
+      case '\t':
+        col = (col / 8 + 1) * 8;
+        if (col >= width)
+          col = width - 1;
+        break;
+      default:
+        put(c);
+      }
+      break;
+
+    case ESCAPE:
+      if (c == '[') {
+        state = CONTROL;
+        count = 0;
+        params[0] = 0;
+        private_mode = false;
+      } else
+        state = TEXT;
+      break;
+
+    case CONTROL:
+      if ((c >= '0') and (c <= '9')) {
+        if (count == 0)
+          count = 1;
+        if (count <= 16)
+          params[count - 1] = csiDigit(params[count - 1], c);
+      } else if (c == ';') {
+        if (count == 0)
+          count = 1;
+        if (count < 16)
+          params[count] = 0;
+        ++count;
+      } else if ((c >= 0x3c) and (c <= 0x3f)) {
+        // < = > ?
+        private_mode = true;
+      } else if ((c >= 0x40) and (c <= 0x7e)) {
+        if (count > 16)
+          count = 16;
+        control(c);
+        state = TEXT;
+      }
+      break;
+    }
+  }
+}
+
+/**
+ * Is this cell blank (nothing but black background)?
+ */
+static bool is_blank(const ANSIArt::Cell &cell) {
+  return ((cell.ch == ' ') or (cell.ch == 0) or (cell.ch == 0xff)) and
+         ((cell.color.value & (PackedColor::BG_MASK | PackedColor::BLINK)) ==
+          0);
+}
+
+/**
+ * Output the ANSI art.
+ *
+ * Colors are only sent when they change, and spaces don't change the
+ * foreground color.  Characters are sent as CP437, or converted to
+ * UTF-8 when unicode is enabled.  The art is clipped to the Door's
+ * screen size.
+ *
+ * With skip blanks (the default), trailing blanks are not sent, and runs
+ * of blanks are skipped by moving the cursor.
+ *
+ * With iCE colors, the blink bit is a bright background, which the
+ * terminal can't show, so the background is sent without it.
+ */
+std::ostream &operator<<(std::ostream &os, const ANSIArt &art) {
+  Door *d = dynamic_cast<Door *>(&os);
+  int cols = art.width;
+  int rows = art.height;
+  PackedColor current;
+
+  if (d != nullptr) {
+    if ((d->width > 0) and (d->width - art.x + 1 < cols))
+      cols = d->width - art.x + 1;
+    if ((d->height > 0) and (d->height - art.y + 1 < rows))
+      rows = d->height - art.y + 1;
+  }
+
+  if ((d != nullptr) and
+      ((d->previous.attr & (ATTR_INVERSE | ATTR_RESET)) == 0) and
+      !d->previous.xfg.extended() and !d->previous.xbg.extended()) {
+    current = d->previous;
+  } else {
+    os << reset;
+  }
+
+  std::string out;
+  out.reserve(cols * 4);
+
+  for (int row = 0; row < rows; ++row) {
+    const ANSIArt::Cell *line = &art.cells[row * art.width];
+    int first = 0;
+    int last = cols - 1;
+
+    if (art.skip_blanks) {
+      while ((last >= 0) and is_blank(line[last]))
+        --last;
+      if (last < 0)
+        continue;
+      while (is_blank(line[first]))
+        ++first;
+    }
+
+    out.clear();
+    int col = first;
+    while (col <= last) {
+      const ANSIArt::Cell &cell = line[col];
+
+      if (art.skip_blanks and is_blank(cell)) {
+        int run = 1;
+        while (is_blank(line[col + run]))
+          ++run;
+        // Skip if it's shorter than the spaces, or the spaces would need
+        // a color change.
+        if ((run >= 4) or
+            (current.value & (PackedColor::BG_MASK | PackedColor::BLINK))) {
+          out += CSI;
+          if (run > 1)
+            out += std::to_string(run);
+          out += 'C';
+          col += run;
+          continue;
+        }
+      }
+
+      PackedColor want = cell.color;
+      if (art.ice)
+        want.value &= ~PackedColor::BLINK;
+
+      bool space = (cell.ch == ' ') or (cell.ch == 0) or (cell.ch == 0xff);
+      if (space and (want.bg() == current.bg()) and
+          (want.blink() == current.blink()))
+        want = current;
+
+      if (want != current) {
+        out += PackedColor::transition(current, want);
+        current = want;
+      }
+
+      if (space)
+        out += ' ';
+      else if (unicode)
+        out += cp437_utf8(cell.ch);
+      else
+        out += (char)cell.ch;
+      ++col;
+    }
+
+    os << Goto(art.x + first, art.y + row);
+    os.write(out.data(), out.length());
+  }
+
+  if (d != nullptr)
+    d->previous = current.color();
+  return os;
+}
+
+/**
+ * @brief Read an escape code, after the ESC.
+ *
+ * @param[in,out] cp moved past the escape code
+ * @param end
+ * @param params at least 16
+ * @param[out] count number of params
+ * @return CSI command, or 0 for anything else
+ */
+static char readCSI(const char *&cp, const char *end, int *params,
+                    int &count) {
+  count = 0;
+  if ((cp == end) or (*cp++ != '['))
+    return 0;
+
+  bool private_mode = false;
+  params[0] = 0;
+  for (; cp < end; ++cp) {
+    char c = *cp;
+    if ((c >= '0') and (c <= '9')) {
+      if (count == 0)
+        count = 1;
+      if (count <= 16)
+        params[count - 1] = csiDigit(params[count - 1], c);
+    } else if (c == ';') {
+      if (count == 0)
+        count = 1;
+      if (count < 16)
+        params[count] = 0;
+      ++count;
+    } else if ((c >= 0x3c) and (c <= 0x3f)) {
+      // < = > ?
+      private_mode = true;
+    } else if ((c >= 0x40) and (c <= 0x7e)) {
+      ++cp;
+      if (count > 16)
+        count = 16;
+      return private_mode ? 0 : c;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief The count of a CSI command (cursor movement), at least 1.
+ *
+ * @param params
+ * @param count number of params
+ * @return int
+ */
+static int csiCount(const int *params, int count) {
+  return ((count > 0) and (params[0] > 0)) ? params[0] : 1;
+}
+
+/**
+ * @brief Is the character a control code the terminal acts on?
+ *
+ * These aren't drawn as symbols by CP437 terminals (bell, backspace,
+ * form feed, shift in/out), so they aren't sent.
+ *
+ * @param c
+ * @return bool
+ */
+static bool terminalControl(unsigned char c) {
+  switch (c) {
+  case 0x00:
+  case 0x07:
+  case 0x08:
+  case 0x0b:
+  case 0x0c:
+  case 0x0e:
+  case 0x0f:
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Construct a new FileViewer
+ *
+ * @param x,y screen position
+ * @param width width of the text
+ * @param rows number of visible rows
+ */
+FileViewer::FileViewer(int x, int y, int width, int rows)
+    : Panel(x, y, width), rows{rows} {}
+
+/**
+ * @brief Open a file to view.
+ *
+ * The file is memory mapped, nothing is read until it is output.  Lines
+ * wrap at the SAUCE width (TInfo1), or 80 columns, as the terminal
+ * wraps them.
+ *
+ * @param filename
+ * @return true if the file was opened
+ */
+bool FileViewer::load(const char *filename) {
+  starts.clear();
+  pens.clear();
+  top = 0;
+  shownTop = -1;
+  if (!file.open(filename))
+    return false;
+
+  wrap = 80;
+  ice = false;
+  length = readSauce(file, wrap, ice);
+  starts.push_back(0);
+  pens.push_back(SGRState());
+  indexed = false;
+  return true;
+}
+
+/**
+ * @brief Find where a line longer than the wrap width wraps.
+ *
+ * The columns are counted as the terminal moves the cursor: the
+ * character after the last column starts the next line, and tabs and
+ * cursor forward stop at the last column.
+ *
+ * @param cp start of the line
+ * @param nl end of the line
+ * @param[in,out] pen color, up to the end of the line
+ * @return const char* start of the next line, or nl + 1
+ */
+const char *FileViewer::wrapLine(const char *cp, const char *nl,
+                                 SGRState &pen) const {
+  int params[16];
+  int count;
+  int col = 0;
+
+  while (cp < nl) {
+    unsigned char c = *cp++;
+    switch (c) {
+    case '\r':
+      break;
+    case 0x1b:
+      switch (readCSI(cp, nl, params, count)) {
+      case 'm':
+        pen.apply(params, count, ice);
+        break;
+      case 'C':
+        col = std::min(col + csiCount(params, count), wrap - 1);
+        break;
+      }
+      break;
+    case '\t':
+      col = std::min((col / 8 + 1) * 8, wrap - 1);
+      break;
+    default:
+      if (col >= wrap)
+        return cp - 1;
+      ++col;
+    }
+  }
+  return nl + 1;
+}
+
+/**
+ * @brief Index the file, until the line is found (or the end).
+ *
+ * Each line is found with memchr, and only its escape codes are looked
+ * at, for the color at the start of the next line.  Lines longer than
+ * the wrap width are split where the terminal wraps them.  EOF (^Z) ends
+ * the file.
+ *
+ * @param line
+ * @return true if the line is in the file
+ */
+bool FileViewer::indexTo(int line) const {
+  const char *text = file.data();
+  int params[16];
+  int count;
+
+  while (!indexed and ((int)starts.size() <= line)) {
+    const char *cp = text + starts.back();
+    const char *end = text + length;
+    const char *nl = (const char *)memchr(cp, '\n', end - cp);
+    if (nl == nullptr)
+      nl = end;
+    const char *eof = (const char *)memchr(cp, 0x1a, nl - cp);
+    if (eof != nullptr) {
+      length = eof - text;
+      nl = eof;
+    }
+
+    SGRState pen = pens.back();
+    const char *next = nl + 1;
+    if (nl - cp > wrap) {
+      // It could be wider than the terminal.
+      next = wrapLine(cp, nl, pen);
+    } else {
+      while ((cp = (const char *)memchr(cp, 0x1b, nl - cp)) != nullptr) {
+        ++cp;
+        if (readCSI(cp, nl, params, count) == 'm')
+          pen.apply(params, count, ice);
+      }
+    }
+
+    if (next >= text + length) {
+      indexed = true;
+      break;
+    }
+    starts.push_back(next - text);
+    pens.push_back(pen);
+  }
+  return line < (int)starts.size();
+}
+
+/**
+ * @brief The number of lines in the file.
+ *
+ * This indexes the rest of the file (once).
+ *
+ * @return int
+ */
+int FileViewer::lineCount(void) const {
+  indexTo(std::numeric_limits<int>::max());
+  return starts.size();
+}
+
+/**
+ * @brief Append the columns of a visible row, exactly width of them.
+ *
+ * @param index visible row
+ * @param out columns
+ */
+void FileViewer::lineCells(int index, std::vector<Line::Cell> &out) const {
+  std::size_t start = out.size();
+  std::size_t want = start + width;
+  int line = top + index;
+  ANSIColor plain = SGRState().color().color();
+
+  // With iCE colors, the terminal can't show a bright background.
+  auto colorOf = [this](const SGRState &pen) -> ANSIColor {
+    PackedColor packed = pen.color();
+    if (ice)
+      packed.value &= ~PackedColor::BLINK;
+    return packed.color();
+  };
+
+  // The next line is indexed too, for where this line ends.
+  indexTo(line + 1);
+  if (line < (int)starts.size()) {
+    const char *text = file.data();
+    const char *cp = text + starts[line];
+    const char *end = text + length;
+    if (line + 1 < (int)starts.size())
+      end = text + starts[line + 1];
+    SGRState pen = pens[line];
+    ANSIColor color = colorOf(pen);
+    int params[16];
+    int count;
+
+    auto put = [&](unsigned char c) {
+      Line::Cell cell;
+      if (unicode) {
+        const std::string &ch = cp437_utf8(c);
+        cell.len = ch.length();
+        memcpy(cell.ch, ch.data(), cell.len);
+      } else {
+        cell.ch[0] = terminalControl(c) ? ' ' : c;
+        cell.len = 1;
+      }
+      cell.color = color;
+      out.push_back(cell);
+    };
+
+    while ((cp < end) and (out.size() < want)) {
+      unsigned char c = *cp++;
+      switch (c) {
+      case '\n':
+        cp = end;
+        break;
+      case '\r':
+        break;
+      case 0x1b:
+        switch (readCSI(cp, end, params, count)) {
+        case 'm':
+          pen.apply(params, count, ice);
+          color = colorOf(pen);
+          break;
+        case 'C':
+          // Cursor forward, over blank columns.
+          for (int n = csiCount(params, count);
+               (n > 0) and (out.size() < want); --n)
+            out.push_back({{' '}, 1, plain});
+          break;
+        }
+        break;
+      case '\t':
+        do
+          put(' ');
+        while ((out.size() < want) and ((out.size() - start) % 8));
+        break;
+      default:
+        put(c);
+      }
+    }
+  }
+
+  while (out.size() < want)
+    out.push_back({{' '}, 1, plain});
+}
+
+/**
+ * @brief Output a visible row.
+ *
+ * @param os
+ * @param row visible row
+ * @param border output the sides of the border too
+ */
+void FileViewer::outputRow(std::ostream &os, int row, bool border) const {
+  beginRow(os, row, border);
+  std::vector<Line::Cell> cells;
+  lineCells(row, cells);
+  outputCells(os, cells);
+  endRow(os, border);
+}
+
+/**
+ * @brief Show the file from a line, and output the changes.
+ *
+ * When the terminal can scroll the rows (see Panel::scrollRows), only
+ * the rows scrolled in are output.  When the viewer is covered on its
+ * Screen, only the visible part of the rows is output.  Nothing is
+ * output until the viewer has been output (or it is on a Screen), or
+ * while it is hidden.
+ *
+ * @param d Door
+ * @param line first line to show
+ * @return true if the first line shown changed
+ */
+bool FileViewer::scroll(Door &d, int line) {
+  if (line < 0)
+    line = 0;
+  if (!indexTo(line + rows - 1))
+    line = std::max(0, (int)starts.size() - rows);
+  if (line == top)
+    return false;
+  top = line;
+  if (hidden) {
+    // The rows are output again once it is shown.
+    shownTop = -1;
+    return true;
+  }
+  if ((shownTop < 0) and !screen)
+    return true;
+
+  // Without the rows shown, they are all output.
+  int lines = (shownTop < 0) ? rows : top - shownTop;
+  shownTop = top;
+  if (scrollRows(d, rows, lines)) {
+    int first = (lines > 0) ? rows - lines : 0;
+    int last = (lines > 0) ? rows : -lines;
+    for (int row = first; row < last; ++row)
+      outputRow(d, row, true);
+  } else {
+    for (int row = 0; row < rows; ++row) {
+      if (occluded)
+        screen->paintLine(d, *this, row);
+      else
+        outputRow(d, row, false);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief View the file, until Enter, Escape or Q.
+ *
+ * Up/Down scroll a line, PgUp/PgDn (or space) a page, Home and End go
+ * to the start and end of the file.
+ *
+ * @param door Door
+ * @return int the key, or < 0 for a timeout.
+ */
+int FileViewer::view(Door &door) {
+  door::ANSIColor blank(door::COLOR::BLACK);
+  door << *this << blank;
+
+  while (true) {
+    int event = door.sleep_key(door.inactivity);
+    if ((event < 0) or (event == 0x0d) or (event == 0x1b) or
+        (event == 'q') or (event == 'Q'))
+      return event;
+
+    int want = top;
+    switch (event) {
+    case XKEY_UP_ARROW:
+      want = top - 1;
+      break;
+    case XKEY_DOWN_ARROW:
+      want = top + 1;
+      break;
+    case XKEY_PGUP:
+      want = top - rows;
+      break;
+    case ' ':
+    case XKEY_PGDN:
+      want = top + rows;
+      break;
+    case XKEY_HOME:
+      want = 0;
+      break;
+    case XKEY_END:
+      want = lineCount() - rows;
+      break;
+    }
+
+    if (scroll(door, want))
+      door << gotoEnd() << blank;
+  }
+}
+
+/**
+ * @brief Output the viewer (borders and visible rows)
+ *
+ * @param os
+ */
+void FileViewer::output(std::ostream &os) const {
+  int style = (int)border_style;
+
+  if (style > 0)
+    outputTop(os);
+
+  for (int row = 0; row < rows; ++row)
+    outputRow(os, row, true);
+
+  if (style > 0) {
+    os << door::Goto(x, y + rows + 1) << border_color;
+    os.write(stripBottom.data(), stripBottom.length());
+  }
+  shownTop = top;
+}
+
+} // namespace door
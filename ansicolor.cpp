@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <string>
 
 #include "door.h"
@@ -9,6 +10,162 @@
 
 namespace door {
 
+/**
+ * @brief Colors the terminal can display.
+ *
+ * Extended colors (XColor) are sent as-is when this isn't ANSI_BBS.
+ */
+ColorDepth color_depth = ColorDepth::ANSI_BBS;
+
+/**
+ * @brief RGB values of the ANSI-BBS colors.
+ *
+ * Index is COLOR, + 8 for bright.
+ */
+static const unsigned char BBS_RGB[16][3] = {
+    {0, 0, 0},      {170, 0, 0},    {0, 170, 0},    {170, 85, 0},
+    {0, 0, 170},    {170, 0, 170},  {0, 170, 170},  {170, 170, 170},
+    {85, 85, 85},   {255, 85, 85},  {85, 255, 85},  {255, 255, 85},
+    {85, 85, 255},  {255, 85, 255}, {85, 255, 255}, {255, 255, 255}};
+
+/**
+ * @brief Lookup tables for quantizing XColor.
+ *
+ * fg tables give COLOR + 8 for bright, bg tables give COLOR (there's
+ * no bright background).  RGB tables are indexed by 5 bits per channel.
+ */
+struct xcolor_luts {
+  std::uint8_t fg256[256];
+  std::uint8_t bg256[256];
+  std::uint8_t fgRGB[32 * 32 * 32];
+  std::uint8_t bgRGB[32 * 32 * 32];
+  /// 0-255 channel to xterm color cube level 0-5
+  std::uint8_t cube[256];
+
+  static std::uint8_t nearest(int r, int g, int b, int count) {
+    int best = 0;
+    long best_distance = -1;
+    for (int i = 0; i < count; ++i) {
+      long dr = r - BBS_RGB[i][0];
+      long dg = g - BBS_RGB[i][1];
+      long db = b - BBS_RGB[i][2];
+      long distance = 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+      if ((best_distance < 0) or (distance < best_distance)) {
+        best = i;
+        best_distance = distance;
+      }
+    }
+    return best;
+  }
+
+  xcolor_luts() {
+    static const int levels[6] = {0, 95, 135, 175, 215, 255};
+
+    for (int i = 0; i < 256; ++i) {
+      int r, g, b;
+      if (i < 16) {
+        // xterm 0-15 are in the same order as the BBS colors.
+        r = BBS_RGB[i][0];
+        g = BBS_RGB[i][1];
+        b = BBS_RGB[i][2];
+      } else if (i < 232) {
+        int c = i - 16;
+        r = levels[c / 36];
+        g = levels[(c / 6) % 6];
+        b = levels[c % 6];
+      } else {
+        r = g = b = 8 + (i - 232) * 10;
+      }
+      fg256[i] = (i < 16) ? i : nearest(r, g, b, 16);
+      bg256[i] = nearest(r, g, b, 8);
+
+      // closest cube level for this channel value
+      int level = 0;
+      for (int l = 1; l < 6; ++l) {
+        if (abs(i - levels[l]) < abs(i - levels[level]))
+          level = l;
+      }
+      cube[i] = level;
+    }
+
+    for (int i = 0; i < 32 * 32 * 32; ++i) {
+      int r = ((i >> 10) & 0x1f) * 255 / 31;
+      int g = ((i >> 5) & 0x1f) * 255 / 31;
+      int b = (i & 0x1f) * 255 / 31;
+      fgRGB[i] = nearest(r, g, b, 16);
+      bgRGB[i] = nearest(r, g, b, 8);
+    }
+  }
+};
+
+/**
+ * The lookup tables are built the first time they're needed.
+ */
+static const xcolor_luts &luts(void) {
+  static const xcolor_luts tables;
+  return tables;
+}
+
+/**
+ * Nearest ANSI-BBS foreground color.
+ *
+ * @return std::uint8_t COLOR, + 8 for bright
+ */
+std::uint8_t XColor::fg16(void) const {
+  switch (kind) {
+    case INDEX:
+      return luts().fg256[r];
+    case RGB:
+      return luts().fgRGB[((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3)];
+    default:
+      return (int)COLOR::WHITE;
+  }
+}
+
+/**
+ * Nearest ANSI-BBS background color.
+ *
+ * @return std::uint8_t COLOR
+ */
+std::uint8_t XColor::bg8(void) const {
+  switch (kind) {
+    case INDEX:
+      return luts().bg256[r];
+    case RGB:
+      return luts().bgRGB[((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3)];
+    default:
+      return (int)COLOR::BLACK;
+  }
+}
+
+/**
+ * Append the extended SGR color parameters (no CSI, no 'm').
+ *
+ * With ColorDepth::COLOR_256, RGB colors are sent as the closest
+ * xterm color cube entry.
+ *
+ * @param[out] out
+ * @param background
+ */
+void XColor::sgr(std::string &out, bool background) const {
+  out += background ? "48;" : "38;";
+  if ((kind == RGB) and (color_depth == ColorDepth::TRUECOLOR)) {
+    out += "2;";
+    out += std::to_string(r) + ";";
+    out += std::to_string(g) + ";";
+    out += std::to_string(b);
+    return;
+  }
+
+  int index = r;
+  if (kind == RGB) {
+    const xcolor_luts &tables = luts();
+    index = 16 + 36 * tables.cube[r] + 6 * tables.cube[g] + tables.cube[b];
+  }
+  out += "5;";
+  out += std::to_string(index);
+}
+
 /**
  * Construct a new ANSIColor::ANSIColor object
  * with sensible defaults (White on Black).
@@ -101,6 +258,28 @@ ANSIColor::ANSIColor(COLOR f, COLOR b, ATTR a1, ATTR a2) : ANSIColor() {
   Attr(a2);
 }
 
+/**
+ * Construct a new ANSIColor::ANSIColor object
+ * with an extended foreground color.
+ *
+ * fg (and BOLD) hold the nearest ANSI-BBS color.
+ *
+ * @param[in] f XColor
+ */
+ANSIColor::ANSIColor(XColor f) : ANSIColor() { setFg(f); }
+
+/**
+ * Construct a new ANSIColor::ANSIColor object
+ * with extended foreground and background colors.
+ *
+ * @param[in] f foreground XColor
+ * @param[in] b background XColor
+ */
+ANSIColor::ANSIColor(XColor f, XColor b) : ANSIColor() {
+  setFg(f);
+  setBg(b);
+}
+
 /**
  * Set attribute.  We return the object so
  * calls can be chained.
@@ -129,7 +308,8 @@ ANSIColor &ANSIColor::Attr(ATTR a) {
 /**
  * Equal operator.
  *
- * This compares colors and attributes, but ignores reset.
+ * This compares colors (including the extended colors) and attributes,
+ * but ignores reset.
  *
  * @param[in] c const ANSIColor &
  * @return bool
@@ -137,22 +317,20 @@ ANSIColor &ANSIColor::Attr(ATTR a) {
 bool ANSIColor::operator==(const ANSIColor &c) const {
   return ((fg == c.fg) and (bg == c.bg) and
           ((attr & (ATTR_BOLD | ATTR_BLINK | ATTR_INVERSE)) ==
-           ((c.attr & (ATTR_BOLD | ATTR_BLINK | ATTR_INVERSE)))));
+           ((c.attr & (ATTR_BOLD | ATTR_BLINK | ATTR_INVERSE)))) and
+          (xfg == c.xfg) and (xbg == c.xbg));
 }
 
 /**
  * Not-equal operator.
  *
- * This compares colors and attributes, but ignores reset.
+ * This compares colors (including the extended colors) and attributes,
+ * but ignores reset.
  *
  * @param[in] c const ANSIColor &
  * @return bool
  */
-bool ANSIColor::operator!=(const ANSIColor &c) const {
-  return !((fg == c.fg) and (bg == c.bg) and
-           ((attr & (ATTR_BOLD | ATTR_BLINK | ATTR_INVERSE)) ==
-            ((c.attr & (ATTR_BOLD | ATTR_BLINK | ATTR_INVERSE)))));
-}
+bool ANSIColor::operator!=(const ANSIColor &c) const { return !(*this == c); }
 
 /**
  * @brief Set foreground color
@@ -161,6 +339,7 @@ bool ANSIColor::operator!=(const ANSIColor &c) const {
  */
 void ANSIColor::setFg(COLOR f) {
   fg = f;
+  xfg = XColor();
   attr = 0;
 }
 
@@ -172,6 +351,7 @@ void ANSIColor::setFg(COLOR f) {
  */
 void ANSIColor::setFg(COLOR f, ATTR a) {
   fg = f;
+  xfg = XColor();
   setAttr(a);
 }
 
@@ -180,7 +360,74 @@ void ANSIColor::setFg(COLOR f, ATTR a) {
  *
  * @param[in] b background COLOR
  */
-void ANSIColor::setBg(COLOR b) { bg = b; }
+void ANSIColor::setBg(COLOR b) {
+  bg = b;
+  xbg = XColor();
+}
+
+/**
+ * @brief Set extended foreground color
+ *
+ * This sets fg and BOLD to the nearest ANSI-BBS color.
+ *
+ * @param[in] f foreground XColor
+ */
+void ANSIColor::setFg(XColor f) {
+  std::uint8_t c = f.fg16();
+  fg = (COLOR)(c & 0x07);
+  xfg = f;
+  if (c & 0x08)
+    attr |= ATTR_BOLD;
+  else
+    attr &= ~ATTR_BOLD;
+}
+
+/**
+ * @brief Set extended background color
+ *
+ * This sets bg to the nearest ANSI-BBS color.
+ *
+ * @param[in] b background XColor
+ */
+void ANSIColor::setBg(XColor b) {
+  bg = (COLOR)b.bg8();
+  xbg = b;
+}
+
+/**
+ * Output the full ANSI codes using the extended colors.
+ *
+ * Extended foreground colors carry their own brightness, so BOLD isn't
+ * sent with them.
+ */
+static std::string output_extended(const ANSIColor &c) {
+  std::string clr(CSI);
+  clr += "0;";
+  if ((c.attr & ATTR_BLINK) == ATTR_BLINK)
+    clr += "5;";
+  if (c.xfg.extended()) {
+    c.xfg.sgr(clr, false);
+  } else {
+    if ((c.attr & ATTR_BOLD) == ATTR_BOLD)
+      clr += "1;";
+    clr += std::to_string(30 + (int)c.fg);
+  }
+  clr += ";";
+  if (c.xbg.extended())
+    c.xbg.sgr(clr, true);
+  else
+    clr += std::to_string(40 + (int)c.bg);
+  clr += "m";
+  return clr;
+}
+
+/**
+ * Should this color be sent with extended color codes?
+ */
+static bool use_extended(const ANSIColor &c) {
+  return (color_depth != ColorDepth::ANSI_BBS) and
+         (c.xfg.extended() or c.xbg.extended());
+}
 
 /**
  * @brief Set attribute
@@ -200,6 +447,9 @@ void ANSIColor::setAttr(ATTR a) {
  * This does not look at the previous values.
  */
 std::string ANSIColor::output(void) const {
+  if (use_extended(*this))
+    return output_extended(*this);
+
   std::string clr(CSI);
 
   // check for special cases
@@ -264,6 +514,16 @@ std::string ANSIColor::debug(void) {
  * This sets previous to the current upon completion.
  */
 std::string ANSIColor::output(ANSIColor &previous) const {
+  if (use_extended(*this) or use_extended(previous)) {
+    // extended colors are always sent in full.
+    std::string clr;
+    if ((attr & ATTR_RESET) or (*this != previous))
+      clr = output_extended(*this);
+    previous = *this;
+    previous.attr &= ~ATTR_RESET;
+    return clr;
+  }
+
   std::string clr(CSI);
   // color output optimization
 
@@ -384,4 +644,83 @@ std::ostream &operator<<(std::ostream &os, const ANSIColor &c) {
 
 ANSIColor reset(ATTR::RESET);
 
+/**
+ * @brief Convert back to an ANSIColor
+ *
+ * @return ANSIColor
+ */
+ANSIColor PackedColor::color(void) const {
+  ANSIColor c(fg(), bg());
+  if (bright())
+    c.attr |= ATTR_BOLD;
+  if (blink())
+    c.attr |= ATTR_BLINK;
+  return c;
+}
+
+/**
+ * @brief Cached SGR sequence for one from/to pair.
+ *
+ * known is 0 until the sequence has been built.  The longest
+ * sequence ANSIColor::output(previous) builds is 14 characters.
+ */
+struct sgr_entry {
+  char seq[15];
+  char known;
+};
+
+/**
+ * @brief SGR transition table, indexed by (from << 8) | to.
+ *
+ * This is zero filled, so only the pages for transitions that
+ * are actually used ever get touched.
+ */
+static sgr_entry sgr_table[256 * 256];
+
+/**
+ * Return the ANSI codes needed to change from one color to another.
+ *
+ * The sequence is built once, using ANSIColor::output(previous), and then
+ * served from the table.
+ *
+ * @param from PackedColor currently on the terminal
+ * @param to PackedColor wanted
+ * @return const char*
+ */
+const char *PackedColor::transition(PackedColor from, PackedColor to) {
+  sgr_entry &entry = sgr_table[(from.index() << 8) | to.index()];
+
+  if (!entry.known) {
+    ANSIColor previous = from.color();
+    std::string clr = to.color().output(previous);
+    if (clr.length() >= sizeof(entry.seq))
+      std::abort();
+    clr.copy(entry.seq, clr.length());
+    entry.seq[clr.length()] = 0;
+    entry.known = 1;
+  }
+  return entry.seq;
+}
+
+/**
+ * Output PackedColor.
+ *
+ * With a Door, this uses the SGR transition table and updates
+ * Door::previous.  Otherwise, the full ANSI codes are sent.
+ */
+std::ostream &operator<<(std::ostream &os, const PackedColor &c) {
+  Door *d = dynamic_cast<Door *>(&os);
+  if ((d != nullptr) and
+      ((d->previous.attr & (ATTR_INVERSE | ATTR_RESET)) == 0) and
+      !use_extended(d->previous)) {
+    d->track = false;
+    *d << PackedColor::transition(d->previous, c);
+    d->previous = c.color();
+    d->track = true;
+  } else {
+    os << c.color();
+  }
+  return os;
+}
+
 }  // namespace door
\ No newline at end of file
@@ -220,6 +220,12 @@ bool full_cp437 = false;
  * This is used by the tests.
  */
 bool debug_capture = false;
+/**
+ * @brief Can the terminal scroll rows (DECSTBM, insert and delete line)?
+ *
+ * Off by default, some BBS terminals don't support scroll regions.
+ */
+bool scroll_region = false;
 
 /**
  * @brief Construct a new Door:: Door object
@@ -231,8 +237,8 @@ bool debug_capture = false;
 Door::Door(std::string dname, int argc, char *argv[])
     : std::ostream(this), doorname{dname},
       has_dropfile{false}, debugging{false}, seconds_elapsed{0},
-      previous(COLOR::WHITE), track{true}, cx{1}, cy{1},
-      inactivity{120}, node{1} {
+      capture{nullptr}, previous(COLOR::WHITE), track{true}, cx{1}, cy{1},
+      width{0}, height{0}, inactivity{120}, node{1} {
 
   // Setup commandline options
   opt.addUsage("Door++ library by BUGZ (C) 2021");
@@ -246,11 +252,15 @@ Door::Door(std::string dname, int argc, char *argv[])
   opt.addUsage(" -u  --username NAME        Set Username");
   opt.addUsage(" -t  --timeleft N           Set time left");
   opt.addUsage("     --maxtime N            Set max time");
+  opt.addUsage("     --256color             Send 256 colors");
+  opt.addUsage("     --truecolor            Send 24 bit colors");
   opt.addUsage("");
   opt.setFlag("help", 'h');
   opt.setFlag("local", 'l');
   opt.setFlag("cp437", 'c');
   opt.setFlag("unicode");
+  opt.setFlag("256color");
+  opt.setFlag("truecolor");
   opt.setFlag("debuggering");
   opt.setOption("dropfile", 'd');
   // opt.setOption("bbsname", 'b');
@@ -376,6 +386,12 @@ Door::Door(std::string dname, int argc, char *argv[])
   if (opt.getFlag("unicode")) {
     unicode = true;
   }
+  if (opt.getFlag("256color")) {
+    color_depth = ColorDepth::COLOR_256;
+  }
+  if (opt.getFlag("truecolor")) {
+    color_depth = ColorDepth::TRUECOLOR;
+  }
 }
 
 Door::~Door() {
@@ -1039,6 +1055,10 @@ signed int Door::sleep_key(int secs) {
   if (time_left < 2)
     return OUTOFTIME;
 
+  // Keys pushed back are ready now.
+  if (!door::pushback.empty())
+    return getkey();
+
   while (select_ret == -1) {
     FD_ZERO(&socket_set);
     FD_SET(STDIN_FILENO, &socket_set);
@@ -1189,9 +1209,26 @@ int Door::get_one_of(const char *keys) {
   return c;
 }
 
+/**
+ * Start capturing the Door's output.
+ *
+ * @param d Door
+ * @param into output is appended here
+ */
+CaptureScope::CaptureScope(Door &d, std::string &into)
+    : door{d}, previous{d.capture} {
+  door.capture = &into;
+}
+
+/**
+ * Restore the previous capture.
+ */
+CaptureScope::~CaptureScope() { door.capture = previous; }
+
 /**
  * Take given buffer and output it.
  *
+ * If capture is set, the output is saved there.
  * If debug_capture is enabled, we save everything to debug_buffer.
  * This is used by the tests.
  *
@@ -1200,20 +1237,20 @@ int Door::get_one_of(const char *keys) {
  * @return std::streamsize
  */
 std::streamsize Door::xsputn(const char *s, std::streamsize n) {
-  if (debug_capture) {
+  if (capture != nullptr) {
+    capture->append(s, n);
+    if (track)
+      cx += n;
+  } else if (debug_capture) {
     debug_buffer.append(s, n);
   } else {
-    static std::string buffer;
-    buffer.append(s, n);
-    // setp(&(*buffer.begin()), &(*buffer.end()));
     if (!hangup) {
-      std::cout << buffer;
+      std::cout.write(s, n);
       std::cout.flush();
     }
     // Tracking character position could be a problem / local terminal unicode.
     if (track)
       cx += n;
-    buffer.clear();
   }
   return n;
 }
@@ -1227,7 +1264,9 @@ std::streamsize Door::xsputn(const char *s, std::streamsize n) {
  * @return int
  */
 int Door::overflow(int c) {
-  if (debug_capture) {
+  if (capture != nullptr) {
+    capture->append(1, (char)c);
+  } else if (debug_capture) {
     debug_buffer.append(1, (char)c);
   } else {
     if (!hangup) {
@@ -1259,6 +1298,106 @@ void ColorOutput::reset(void) {
   len = 0;
 }
 
+/**
+ * The color of the fragment, with the extended colors.
+ *
+ * @return ANSIColor
+ */
+ANSIColor ColorOutput::color(void) const {
+  ANSIColor color = c.color();
+  color.xfg = xfg;
+  color.xbg = xbg;
+  return color;
+}
+
+thread_local FrameArena *FrameArena::current = nullptr;
+
+FrameArena frame_arena;
+
+/**
+ * Construct a new FrameArena.
+ *
+ * @param size default size of the blocks
+ */
+FrameArena::FrameArena(std::size_t size)
+    : block{0}, used{0}, blockSize{size}, depth{0} {}
+
+/**
+ * Allocate memory.
+ *
+ * Blocks kept from earlier frames are used before new ones are made.
+ *
+ * @param bytes size
+ * @param align alignment (power of 2)
+ * @return void*
+ */
+void *FrameArena::allocate(std::size_t bytes, std::size_t align) {
+  while (true) {
+    if (block < blocks.size()) {
+      Block &b = blocks[block];
+      std::uintptr_t base = (std::uintptr_t)b.data.get();
+      std::size_t start = ((base + used + align - 1) & ~(align - 1)) - base;
+      if (start + bytes <= b.size) {
+        used = start + bytes;
+        return b.data.get() + start;
+      }
+      if (block + 1 < blocks.size()) {
+        ++block;
+        used = 0;
+        continue;
+      }
+    }
+
+    Block b;
+    b.size = std::max(blockSize, bytes + align);
+    b.data.reset(new char[b.size]);
+    blocks.push_back(std::move(b));
+    block = blocks.size() - 1;
+    used = 0;
+  }
+}
+
+/**
+ * Release everything allocated.
+ *
+ * The blocks are kept for the next frame.
+ */
+void FrameArena::reset(void) {
+  block = 0;
+  used = 0;
+}
+
+/**
+ * Total size of the blocks.
+ *
+ * @return std::size_t
+ */
+std::size_t FrameArena::capacity(void) const {
+  std::size_t total = 0;
+  for (const Block &b : blocks)
+    total += b.size;
+  return total;
+}
+
+/**
+ * Start using the arena for temporaries.
+ *
+ * @param a FrameArena
+ */
+FrameScope::FrameScope(FrameArena &a) : arena{a}, previous{FrameArena::current} {
+  FrameArena::current = &a;
+  ++a.depth;
+}
+
+/**
+ * Stop using the arena, and reset it if this is the outer most scope.
+ */
+FrameScope::~FrameScope() {
+  FrameArena::current = previous;
+  if (--arena.depth == 0)
+    arena.reset();
+}
+
 /**
  * Construct a new Render:: Render object
  *
@@ -1267,33 +1406,79 @@ void ColorOutput::reset(void) {
  *
  * @param txt Text
  */
-Render::Render(const std::string txt) : text{txt} {}
+Render::Render(const std::string &txt) : text{txt.data(), txt.length()} {}
+
+/**
+ * Construct a new Render:: Render object from part of a string.
+ *
+ * @param txt text
+ * @param len length of text
+ */
+Render::Render(const char *txt, std::size_t len) : text{txt, len} {}
+
+/**
+ * Construct a Render, with the text and outputs in an arena.
+ *
+ * This is for temporaries inside a FrameScope, that don't outlive it.
+ *
+ * @param txt text
+ * @param len length of text
+ * @param arena FrameArena, or nullptr for the heap
+ */
+Render::Render(const char *txt, std::size_t len, FrameArena *arena)
+    : text{txt, len, ArenaAllocator<char>(arena)},
+      outputs{ArenaAllocator<ColorOutput>(arena)} {}
 
 /**
  * Output the Render.
  *
- * This consists of going through the vector, getting
- * the fragment (from pos and len), and outputting the
- * color and fragment.
+ * This consists of going through the vector, and outputting the
+ * color and fragment (from pos and len).  The fragment is written
+ * directly from the text, no temporary strings are made.
  *
  * @param os
  */
-void Render::output(std::ostream &os) {
-  for (auto out : outputs) {
-    std::string fragment = text.substr(out.pos, out.len);
-    os << out.c << fragment;
+void Render::output(std::ostream &os) const {
+  const char *data = text.data();
+  int length = text.length();
+
+  for (const ColorOutput &out : outputs) {
+    if (out.pos >= length)
+      break;
+    int len = std::min(out.len, length - out.pos);
+    if (out.extended())
+      os << out.color();
+    else
+      os << out.c;
+    os.write(data + out.pos, len);
   }
 }
 
+/**
+ * Reserve space for runs.
+ *
+ * @param runs number of color runs expected
+ */
+void Render::reserve(int runs) { outputs.reserve(runs); }
+
+/**
+ * Reserve space for the most runs the text could need.
+ *
+ * There can't be more runs than bytes of text, so after this
+ * appending never reallocates.
+ */
+void Render::reserve(void) { outputs.reserve(text.length()); }
+
 /**
  * Create render output.
  *
- * Call this for each section you want to colorize.
+ * Call this for each section you want to colorize.  Appending the
+ * same color as the last section extends it.
  *
  * @param color
- * @param len
+ * @param len number of bytes in this color
  */
-void Render::append(ANSIColor color, int len) {
+void Render::append(PackedColor color, int len) {
   if (outputs.empty()) {
     ColorOutput co;
     co.c = color;
@@ -1303,7 +1488,7 @@ void Render::append(ANSIColor color, int len) {
     return;
   }
   ColorOutput &current = outputs.back();
-  if (current.c == color) {
+  if ((current.c == color) and !current.extended()) {
     current.len += len;
     return;
   }
@@ -1316,6 +1501,292 @@ void Render::append(ANSIColor color, int len) {
   outputs.push_back(co);
 }
 
+/**
+ * Create render output, keeping extended (256 color, truecolor) colors.
+ *
+ * They are sent as they are when the terminal can show them (see
+ * door::color_depth).
+ *
+ * @param color
+ * @param len number of bytes in this color
+ */
+void Render::append(const ANSIColor &color, int len) {
+  PackedColor packed(color);
+  if (!outputs.empty()) {
+    ColorOutput &current = outputs.back();
+    if ((current.c == packed) and (current.xfg == color.xfg) and
+        (current.xbg == color.xbg)) {
+      current.len += len;
+      return;
+    }
+  }
+  ColorOutput co;
+  co.c = packed;
+  co.xfg = color.xfg;
+  co.xbg = color.xbg;
+  co.pos = outputs.empty() ? 0 : outputs.back().pos + outputs.back().len;
+  co.len = len;
+  outputs.push_back(co);
+}
+
+/**
+ * Build the render output from a color index for each byte of text.
+ *
+ * This replaces any output already appended.  The runs are counted
+ * first, so the outputs are allocated once.
+ *
+ * @param index palette index for each byte of text
+ * @param palette colors
+ */
+void Render::build(const unsigned char *index, const PackedColor *palette) {
+  int length = text.length();
+  outputs.clear();
+  if (length == 0)
+    return;
+
+  int runs = 1;
+  for (int i = 1; i < length; ++i) {
+    if (palette[index[i]] != palette[index[i - 1]])
+      ++runs;
+  }
+  outputs.reserve(runs);
+
+  int start = 0;
+  for (int i = 1; i <= length; ++i) {
+    if ((i == length) or (palette[index[i]] != palette[index[start]])) {
+      ColorOutput co;
+      co.c = palette[index[start]];
+      co.pos = start;
+      co.len = i - start;
+      outputs.push_back(co);
+      start = i;
+    }
+  }
+}
+
+/**
+ * Construct a new RenderRule.
+ *
+ * @param other color for all bytes
+ */
+RenderRule::RenderRule(const ANSIColor &other) : brackets{false} {
+  all(other);
+}
+
+/**
+ * Find (or add) a color in the palette.
+ *
+ * When the palette is full, the colors no byte uses are dropped.
+ *
+ * @param c color
+ * @return unsigned char palette index
+ */
+unsigned char RenderRule::paletteIndex(const ANSIColor &c) {
+  for (std::size_t i = 0; i < palette.size(); ++i) {
+    if (palette[i] == c)
+      return i;
+  }
+  if (palette.size() == 256) {
+    std::vector<ANSIColor> used;
+    unsigned char moved[256];
+    for (std::size_t i = 0; i < palette.size(); ++i) {
+      if (std::find(table, table + 256, i) != table + 256) {
+        moved[i] = used.size();
+        used.push_back(palette[i]);
+      }
+    }
+    for (unsigned char &index : table)
+      index = moved[index];
+    palette.swap(used);
+  }
+  palette.push_back(c);
+  return palette.size() - 1;
+}
+
+/**
+ * Set the color of every byte.
+ *
+ * @param c color
+ * @return RenderRule&
+ */
+RenderRule &RenderRule::all(const ANSIColor &c) {
+  palette.clear();
+  palette.push_back(c);
+  for (int i = 0; i < 256; ++i)
+    table[i] = 0;
+  return *this;
+}
+
+/**
+ * Set the color of upper case letters.
+ *
+ * @param c color
+ * @return RenderRule&
+ */
+RenderRule &RenderRule::upper(const ANSIColor &c) {
+  unsigned char index = paletteIndex(c);
+  for (int i = 'A'; i <= 'Z'; ++i)
+    table[i] = index;
+  return *this;
+}
+
+/**
+ * Set the color of lower case letters.
+ *
+ * @param c color
+ * @return RenderRule&
+ */
+RenderRule &RenderRule::lower(const ANSIColor &c) {
+  unsigned char index = paletteIndex(c);
+  for (int i = 'a'; i <= 'z'; ++i)
+    table[i] = index;
+  return *this;
+}
+
+/**
+ * Set the color of digits.
+ *
+ * @param c color
+ * @return RenderRule&
+ */
+RenderRule &RenderRule::digit(const ANSIColor &c) {
+  unsigned char index = paletteIndex(c);
+  for (int i = '0'; i <= '9'; ++i)
+    table[i] = index;
+  return *this;
+}
+
+/**
+ * Set the color of spaces.
+ *
+ * @param c color
+ * @return RenderRule&
+ */
+RenderRule &RenderRule::space(const ANSIColor &c) {
+  table[(unsigned char)' '] = paletteIndex(c);
+  return *this;
+}
+
+/**
+ * Set the color of punctuation.
+ *
+ * @param c color
+ * @return RenderRule&
+ */
+RenderRule &RenderRule::punct(const ANSIColor &c) {
+  unsigned char index = paletteIndex(c);
+  for (int i = 0; i < 128; ++i) {
+    if (ispunct(i))
+      table[i] = index;
+  }
+  return *this;
+}
+
+/**
+ * Set the color of the given bytes.
+ *
+ * @param which bytes to set
+ * @param c color
+ * @return RenderRule&
+ */
+RenderRule &RenderRule::chars(const char *which, const ANSIColor &c) {
+  unsigned char index = paletteIndex(c);
+  while (*which != 0) {
+    table[(unsigned char)*which] = index;
+    ++which;
+  }
+  return *this;
+}
+
+/**
+ * Color the menu option.
+ *
+ * Until the first ']', brackets are in the bracket color, and
+ * everything else is in the option color.
+ *
+ * @param bracket color of [ and ]
+ * @param option color inside the brackets
+ * @return RenderRule&
+ */
+RenderRule &RenderRule::option(const ANSIColor &bracket,
+                               const ANSIColor &option) {
+  brackets = true;
+  bracketColor = bracket;
+  optionColor = option;
+  return *this;
+}
+
+/**
+ * Render the text.
+ *
+ * @param txt text to render
+ * @return Render
+ */
+Render RenderRule::operator()(const std::string &txt) const {
+  return (*this)(txt.data(), txt.length());
+}
+
+/**
+ * Render the text.
+ *
+ * @param txt text to render
+ * @param len length of text
+ * @return Render
+ */
+Render RenderRule::operator()(const char *txt, std::size_t len) const {
+  return render(txt, len, nullptr);
+}
+
+/**
+ * Render the text, into an arena.
+ *
+ * @param txt text to render
+ * @param len length of text
+ * @param arena FrameArena, or nullptr for the heap
+ * @return Render
+ */
+Render RenderRule::render(const char *txt, std::size_t len,
+                          FrameArena *arena) const {
+  Render r(txt, len, arena);
+  const unsigned char *cp = (const unsigned char *)txt;
+  const unsigned char *end = cp + len;
+
+  if (cp == end)
+    return r;
+  r.reserve();
+
+  if (brackets) {
+    const unsigned char *start = cp;
+    const ANSIColor *color =
+        (*cp == '[' or *cp == ']') ? &bracketColor : &optionColor;
+
+    while (cp < end) {
+      bool last = (*cp == ']');
+      const ANSIColor *next =
+          (*cp == '[' or *cp == ']') ? &bracketColor : &optionColor;
+      if (next != color) {
+        r.append(*color, cp - start);
+        start = cp;
+        color = next;
+      }
+      ++cp;
+      if (last)
+        break;
+    }
+    r.append(*color, cp - start);
+  }
+
+  while (cp < end) {
+    const unsigned char *start = cp;
+    unsigned char index = table[*cp];
+    ++cp;
+    while ((cp < end) and (table[*cp] == index))
+      ++cp;
+    r.append(palette[index], cp - start);
+  }
+  return r;
+}
+
 /**
  * Construct a new Clrscr:: Clrscr object
  *
@@ -1440,19 +1911,8 @@ const char RestoreCursor[] = "\x1b[u";
 // EXAMPLES
 
 /// BlueYellow Render example function
-renderFunction rBlueYellow = [](const std::string &txt) -> Render {
-  Render r(txt);
-
-  ANSIColor blue(COLOR::BLUE, ATTR::BOLD);
-  ANSIColor cyan(COLOR::YELLOW, ATTR::BOLD);
-
-  for (char const &c : txt) {
-    if (isupper(c))
-      r.append(blue);
-    else
-      r.append(cyan);
-  }
-  return r;
-};
+renderFunction rBlueYellow =
+    RenderRule(ANSIColor(COLOR::YELLOW, ATTR::BOLD))
+        .upper(ANSIColor(COLOR::BLUE, ATTR::BOLD));
 
 } // namespace door
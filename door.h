@@ -1,6 +1,7 @@
 #ifndef DOOR_H
 #define DOOR_H
 
+#include <array>
 #include <cstdint>
 #include <ctime>
 #include <fstream>
@@ -10,6 +11,9 @@
 #include <list>
 #include <memory>
 #include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "anyoption.h"
@@ -64,8 +68,23 @@ namespace door {
 extern bool unicode;
 extern bool full_cp437;
 extern bool debug_capture;
+extern bool scroll_region;
 extern std::list<char> pushback;
 
+/**
+ * @brief Colors the terminal can display.
+ */
+enum class ColorDepth {
+  /// ANSI-BBS 8 colors + bright (default)
+  ANSI_BBS,
+  /// xterm 256 colors
+  COLOR_256,
+  /// 24 bit RGB colors
+  TRUECOLOR
+};
+
+extern ColorDepth color_depth;
+
 /*
 Translate CP437 strings to unicode for output.
 
@@ -145,6 +164,51 @@ enum Attribute {
   ATTR_RESET = 0x08,
 };
 
+/**
+ * @class XColor
+ * This holds an extended color, either an xterm 256 color index or
+ * a 24 bit RGB color.
+ *
+ * These are quantized to the nearest ANSI-BBS color by lookup tables,
+ * so this is cheap enough to use per character.
+ *
+ * @brief 256 color or truecolor value
+ */
+class XColor {
+ public:
+  /// What kind of color this holds
+  enum Kind : std::uint8_t { NONE, INDEX, RGB };
+
+  /// Kind of color
+  Kind kind;
+  /// Red, or the 256 color index
+  std::uint8_t r;
+  /// Green
+  std::uint8_t g;
+  /// Blue
+  std::uint8_t b;
+
+  /// No extended color
+  constexpr XColor() : kind{NONE}, r{0}, g{0}, b{0} {}
+  /// xterm 256 color index
+  constexpr explicit XColor(std::uint8_t index)
+      : kind{INDEX}, r{index}, g{0}, b{0} {}
+  /// 24 bit RGB color
+  constexpr XColor(std::uint8_t red, std::uint8_t green, std::uint8_t blue)
+      : kind{RGB}, r{red}, g{green}, b{blue} {}
+
+  /// Is there an extended color?
+  constexpr bool extended(void) const { return kind != NONE; }
+  constexpr bool operator==(const XColor &c) const {
+    return (kind == c.kind) and (r == c.r) and (g == c.g) and (b == c.b);
+  }
+  constexpr bool operator!=(const XColor &c) const { return !(*this == c); }
+
+  std::uint8_t fg16(void) const;
+  std::uint8_t bg8(void) const;
+  void sgr(std::string &out, bool background) const;
+};
+
 /**
  * @class ANSIColor
  * This holds foreground, background and ANSI-BBS attribute
@@ -163,6 +227,10 @@ class ANSIColor {
   COLOR bg;
   // Track attributes (ATTR)
   unsigned char attr;
+  /** Extended foreground color (fg holds the quantized color) */
+  XColor xfg;
+  /** Extended background color (bg holds the quantized color) */
+  XColor xbg;
 
   /** reset flag / always send color and attributes */
   // unsigned int reset : 1;
@@ -176,7 +244,7 @@ class ANSIColor {
  public:
   ANSIColor();
   constexpr ANSIColor(const char *text)
-      : fg{COLOR::WHITE}, bg{COLOR::BLACK}, attr{0} {
+      : fg{COLOR::WHITE}, bg{COLOR::BLACK}, attr{0}, xfg{}, xbg{} {
     const char *cp = text;
     bool use_on = false;
 
@@ -276,12 +344,16 @@ class ANSIColor {
   ANSIColor(COLOR f, COLOR b);
   ANSIColor(COLOR f, COLOR b, ATTR a);
   ANSIColor(COLOR f, COLOR b, ATTR a1, ATTR a2);
+  ANSIColor(XColor f);
+  ANSIColor(XColor f, XColor b);
   ANSIColor &Attr(ATTR a);
   bool operator==(const ANSIColor &c) const;
   bool operator!=(const ANSIColor &c) const;
   void setFg(COLOR f);
   void setFg(COLOR f, ATTR a);
   void setBg(COLOR b);
+  void setFg(XColor f);
+  void setBg(XColor b);
   /**
    * Get the foreground color
    * @return COLOR
@@ -300,6 +372,69 @@ class ANSIColor {
   friend std::ostream &operator<<(std::ostream &os, const ANSIColor &c);
 };
 
+/**
+ * @class PackedColor
+ * This holds an ANSIColor packed into a single CGA style attribute byte.
+ *
+ * Bits 0-2 are the foreground color, bit 3 is bright, bits 4-6 are the
+ * background color and bit 7 is blink.  INVERSE is folded in by swapping
+ * the foreground and background.  RESET is not a color, so it isn't kept.
+ *
+ * The value can be used directly as an index into the SGR transition table.
+ * \see PackedColor::transition()
+ *
+ * @brief One byte color and attributes
+ */
+class PackedColor {
+ public:
+  /// CGA attribute bits
+  enum : std::uint8_t {
+    FG_MASK = 0x07,
+    BRIGHT = 0x08,
+    BG_MASK = 0x70,
+    BLINK = 0x80
+  };
+
+  /// Packed attribute byte
+  std::uint8_t value;
+
+  /// White on Black
+  constexpr PackedColor() : value{0x07} {}
+  constexpr explicit PackedColor(std::uint8_t v) : value{v} {}
+  constexpr PackedColor(COLOR f, COLOR b, bool bright = false,
+                        bool blink = false)
+      : value{(std::uint8_t)(((int)f & 0x07) | (((int)b & 0x07) << 4) |
+                             (bright ? BRIGHT : 0) | (blink ? BLINK : 0))} {}
+  constexpr PackedColor(const ANSIColor &c)
+      : PackedColor((c.attr & ATTR_INVERSE) ? c.bg : c.fg,
+                    (c.attr & ATTR_INVERSE) ? c.fg : c.bg,
+                    (c.attr & ATTR_BOLD) != 0, (c.attr & ATTR_BLINK) != 0) {}
+
+  /// Foreground color
+  constexpr COLOR fg(void) const { return (COLOR)(value & FG_MASK); }
+  /// Background color
+  constexpr COLOR bg(void) const { return (COLOR)((value & BG_MASK) >> 4); }
+  /// Bright / bold
+  constexpr bool bright(void) const { return (value & BRIGHT) != 0; }
+  /// Blink
+  constexpr bool blink(void) const { return (value & BLINK) != 0; }
+  /// Table index
+  constexpr std::uint8_t index(void) const { return value; }
+
+  constexpr bool operator==(const PackedColor &c) const {
+    return value == c.value;
+  }
+  constexpr bool operator!=(const PackedColor &c) const {
+    return value != c.value;
+  }
+
+  ANSIColor color(void) const;
+  operator ANSIColor() const { return color(); }
+
+  static const char *transition(PackedColor from, PackedColor to);
+  friend std::ostream &operator<<(std::ostream &os, const PackedColor &c);
+};
+
 /**
  * @class Door
  *
@@ -336,6 +471,10 @@ class Door : public std::ostream, private std::streambuf {
   void time_thread_run(std::future<void> future);
   /** Thread used to update time_left and time_used. */
   std::thread time_thread;
+  /** When set, output is appended here instead of being sent. */
+  std::string *capture;
+
+  friend class CaptureScope;
 
  public:
   Door(std::string dname, int argc, char *argv[]);
@@ -346,6 +485,8 @@ class Door : public std::ostream, private std::streambuf {
   AnyOption opt;
   /** Buffer that holds the output for testing. */
   std::string debug_buffer;
+  /** Where output is being captured (see CaptureScope), or nullptr */
+  const std::string *capturing(void) const { return capture; };
 
   /**
    * Previous ANSI-BBS colors and attributes sent.
@@ -394,15 +535,334 @@ class Door : public std::ostream, private std::streambuf {
   int get_one_of(const char *keys);
 };
 
+/**
+ * @class CaptureScope
+ * Append the Door's output to a string while this is in scope, instead
+ * of sending it.
+ *
+ * The previous capture is restored when the scope ends, even by an
+ * exception.
+ *
+ * @brief Capture Door output
+ */
+class CaptureScope {
+  Door &door;
+  /// Capture of the enclosing scope
+  std::string *previous;
+
+ public:
+  CaptureScope(Door &d, std::string &into);
+  CaptureScope(const CaptureScope &) = delete;
+  CaptureScope &operator=(const CaptureScope &) = delete;
+  ~CaptureScope();
+};
+
+/**
+ * @brief ANSI codes to set a PackedColor from any previous state.
+ *
+ * This always starts with 0 (reset), so it doesn't depend on what
+ * was sent before.  The longest is "\x1b[0;5;1;37;47m" (14 chars).
+ */
+struct SGRCodes {
+  /// The ANSI codes
+  char seq[15];
+  /// Length of seq
+  std::size_t len;
+};
+
+/**
+ * Build the ANSI codes for the given color at compile time.
+ *
+ * @param c PackedColor
+ * @return SGRCodes
+ */
+constexpr SGRCodes sgrCodes(PackedColor c) {
+  SGRCodes s{{0}, 0};
+  s.seq[s.len++] = '\x1b';
+  s.seq[s.len++] = '[';
+  s.seq[s.len++] = '0';
+  s.seq[s.len++] = ';';
+  if (c.blink()) {
+    s.seq[s.len++] = '5';
+    s.seq[s.len++] = ';';
+  }
+  if (c.bright()) {
+    s.seq[s.len++] = '1';
+    s.seq[s.len++] = ';';
+  }
+  s.seq[s.len++] = '3';
+  s.seq[s.len++] = '0' + (int)c.fg();
+  s.seq[s.len++] = ';';
+  s.seq[s.len++] = '4';
+  s.seq[s.len++] = '0' + (int)c.bg();
+  s.seq[s.len++] = 'm';
+  return s;
+}
+
+/**
+ * @class ColorText
+ * ANSI color codes and text, encoded at compile time.
+ *
+ * Use \ref DOOR_TEXT to build these.  Sending one to the Door is a
+ * single write of bytes, and Door::previous is set to the color.
+ *
+ * @brief Pre-encoded color and text
+ */
+template <std::size_t N> class ColorText {
+ public:
+  /// ANSI codes followed by the text
+  std::array<char, N> bytes;
+  /// Length of the ANSI codes
+  std::size_t sgr_length;
+  /// Total length used in bytes
+  std::size_t length;
+  /// Color the text is displayed in
+  PackedColor color;
+};
+
+/// Return the byte at position pos of the ANSI codes + text.
+template <std::size_t TN>
+constexpr char colorTextChar(PackedColor c, const char (&text)[TN],
+                             std::size_t pos) {
+  return (pos < sgrCodes(c).len)
+             ? sgrCodes(c).seq[pos]
+             : ((pos - sgrCodes(c).len < TN - 1) ? text[pos - sgrCodes(c).len]
+                                                 : 0);
+}
+
+/// Build the ColorText bytes, one index at a time.
+template <std::size_t TN, std::size_t... I>
+constexpr ColorText<sizeof(SGRCodes::seq) - 1 + TN - 1>
+makeColorText(PackedColor c, const char (&text)[TN],
+              std::index_sequence<I...>) {
+  return ColorText<sizeof(SGRCodes::seq) - 1 + TN - 1>{
+      {{colorTextChar(c, text, I)...}},
+      sgrCodes(c).len,
+      sgrCodes(c).len + TN - 1,
+      c};
+}
+
+/**
+ * Encode color and text into a ColorText.
+ *
+ * @param c PackedColor
+ * @param text string literal
+ * @return ColorText
+ */
+template <std::size_t TN>
+constexpr ColorText<sizeof(SGRCodes::seq) - 1 + TN - 1>
+makeColorText(PackedColor c, const char (&text)[TN]) {
+  return makeColorText(
+      c, text, std::make_index_sequence<sizeof(SGRCodes::seq) - 1 + TN - 1>{});
+}
+
+/**
+ * Output ColorText.
+ *
+ * The ANSI codes reset everything, so with a Door we know exactly
+ * what state the terminal is in afterwards.  Door::previous is set to
+ * the ColorText color.
+ */
+template <std::size_t N>
+std::ostream &operator<<(std::ostream &os, const ColorText<N> &ct) {
+  Door *d = dynamic_cast<Door *>(&os);
+  if (d != nullptr) {
+    d->track = false;
+    d->write(ct.bytes.data(), ct.sgr_length);
+    d->track = true;
+    d->write(ct.bytes.data() + ct.sgr_length, ct.length - ct.sgr_length);
+    d->previous = ct.color.color();
+  } else {
+    os.write(ct.bytes.data(), ct.length);
+  }
+  return os;
+}
+
+/**
+ * Compile time colored string literal.
+ *
+ * ~~~{.cpp}
+ * door << DOOR_TEXT("BRI WHI ON BLU", "Press a key");
+ * ~~~
+ */
+#define DOOR_TEXT(color, text)                                                 \
+  ([]() -> const auto & {                                                      \
+    static constexpr auto door_text =                                          \
+        ::door::makeColorText(::door::ANSIColor(color), text);                 \
+    return door_text;                                                          \
+  }())
+
+/**
+ * @class FrameArena
+ * Monotonic memory for the temporaries of one frame.
+ *
+ * Memory is handed out from blocks, and is only given back (all at once)
+ * by reset().  The blocks are kept, so once the arena has grown to the
+ * size of a frame, rendering doesn't call malloc/free.
+ *
+ * Allocations come from the arena while a FrameScope is active.
+ *
+ * @brief Per-frame arena
+ */
+class FrameArena {
+  /// Block of memory
+  struct Block {
+    /// Memory
+    std::unique_ptr<char[]> data;
+    /// Size of data
+    std::size_t size;
+  };
+  /// Blocks of memory
+  std::vector<Block> blocks;
+  /// Block in use
+  std::size_t block;
+  /// Bytes used in the current block
+  std::size_t used;
+  /// Default block size
+  std::size_t blockSize;
+  /// Number of active FrameScopes
+  int depth;
+
+  /// The arena of the active FrameScope
+  static thread_local FrameArena *current;
+
+  friend class FrameScope;
+
+ public:
+  explicit FrameArena(std::size_t blockSize = 16384);
+  FrameArena(const FrameArena &) = delete;
+
+  void *allocate(std::size_t bytes, std::size_t align);
+  void reset(void);
+  std::size_t capacity(void) const;
+
+  /// The arena of the active FrameScope, or nullptr
+  static FrameArena *active(void) { return current; };
+};
+
+/// Arena used by FrameScope
+extern FrameArena frame_arena;
+
+/**
+ * @class FrameScope
+ * Use the arena for temporaries while this is in scope.
+ *
+ * FrameScopes can be nested, the arena is reset when the outer most
+ * FrameScope ends.  Nothing allocated from the arena may outlive it.
+ *
+ * ~~~{.cpp}
+ * {
+ *   door::FrameScope frame;
+ *   screen.update(door);
+ * }
+ * ~~~
+ *
+ * @brief Frame scope
+ */
+class FrameScope {
+  /// Arena being used
+  FrameArena &arena;
+  /// Arena of the enclosing FrameScope
+  FrameArena *previous;
+
+ public:
+  FrameScope(FrameArena &a = frame_arena);
+  FrameScope(const FrameScope &) = delete;
+  ~FrameScope();
+};
+
+/**
+ * @class ArenaAllocator
+ * Allocator that uses a FrameArena, or the heap.
+ *
+ * The default is the heap, so containers can be kept.  Only temporaries
+ * inside the library are given the arena, with
+ * ArenaAllocator(FrameArena::active()).  Copies of containers use the
+ * heap, and move assignment keeps the target's allocator, so neither
+ * can take the arena out of the frame.
+ *
+ * @brief Allocator for frame temporaries
+ */
+template <typename T> class ArenaAllocator {
+ public:
+  typedef T value_type;
+  /// Keep the target's allocator when move assigning
+  typedef std::false_type propagate_on_container_move_assignment;
+  /// Propagate the arena when swapping
+  typedef std::true_type propagate_on_container_swap;
+
+  /// Arena, or nullptr for the heap
+  FrameArena *arena;
+
+  ArenaAllocator() noexcept : arena{nullptr} {}
+  explicit ArenaAllocator(FrameArena *a) noexcept : arena{a} {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) noexcept
+      : arena{other.arena} {}
+
+  /**
+   * Allocate n T
+   *
+   * @param n number of T
+   * @return T*
+   */
+  T *allocate(std::size_t n) {
+    if (arena != nullptr)
+      return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  };
+
+  /**
+   * Free memory (the arena frees when it is reset)
+   *
+   * @param p memory from allocate
+   */
+  void deallocate(T *p, std::size_t) noexcept {
+    if (arena == nullptr)
+      ::operator delete(p);
+  };
+
+  /// Copies use the heap
+  ArenaAllocator select_on_container_copy_construction(void) const {
+    return ArenaAllocator(nullptr);
+  };
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena != b.arena;
+}
+
+/**
+ * Allocator for a temporary, from the active FrameArena (or the heap if
+ * there isn't one).
+ *
+ * ~~~{.cpp}
+ * Spans spans{frameAllocator<Spans::value_type>()};
+ * ~~~
+ */
+template <typename T> ArenaAllocator<T> frameAllocator(void) {
+  return ArenaAllocator<T>(FrameArena::active());
+}
+
+/// String that can use a FrameArena
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>
+    ArenaString;
+
 // Use this to define the deprecated colorizer  [POC]
 // typedef std::function<void(Door &, std::string &)> colorFunction;
 
 /**
  * @class ColorOutput
  * This works with \ref Render to create the output.  This consists
- * of ANSIColor and text position + length.
+ * of PackedColor (and any extended colors) and text position + length.
  *
- * @brief This holds an ANSIColor and text position + length
+ * @brief This holds a PackedColor and text position + length
  *
  */
 class ColorOutput {
@@ -410,12 +870,20 @@ class ColorOutput {
   ColorOutput();
   void reset(void);
 
-  /// Color to use for this fragment
-  ANSIColor c;
+  /// Color to use for this fragment (quantized, with extended colors)
+  PackedColor c;
+  /// Extended foreground color
+  XColor xfg;
+  /// Extended background color
+  XColor xbg;
   /// Starting position of Render.text
   int pos;
   /// Length
   int len;
+
+  /// Does the fragment have extended colors?
+  bool extended(void) const { return xfg.extended() or xbg.extended(); };
+  ANSIColor color(void) const;
 };
 
 /*
@@ -435,15 +903,25 @@ Instead, return an iterator/generator.
  */
 class Render {
   /// Complete text to be rendered.
-  std::string text;
+  ArenaString text;
 
  public:
-  Render(const std::string txt);
+  Render(const std::string &txt);
+  Render(const char *txt, std::size_t len);
+  Render(const char *txt, std::size_t len, FrameArena *arena);
 
+  /// ColorOutputs, from the heap or a FrameArena
+  typedef std::vector<ColorOutput, ArenaAllocator<ColorOutput>> ColorOutputs;
   /// Vector of ColorOutput object.
-  std::vector<ColorOutput> outputs;
-  void append(ANSIColor color, int len = 1);
-  void output(std::ostream &os);
+  ColorOutputs outputs;
+  void reserve(int runs);
+  void reserve(void);
+  void append(PackedColor color, int len = 1);
+  void append(const ANSIColor &color, int len = 1);
+  void build(const unsigned char *index, const PackedColor *palette);
+  void output(std::ostream &os) const;
+  /// Text being rendered.
+  const ArenaString &getText(void) const { return text; };
 };
 
 /**
@@ -456,12 +934,12 @@ class Render {
  * door::RenderFunction render = [upperColor, lowerColor]
  *                               (const std::string &text) -> door::Render {
  *   door::Render r(text);
- *   for (char const &c : text) {
- *     if (std::isupper(c))
- *       r.append(upperColor);
- *     else
- *       r.append(lowerColor);
- *   }
+ *   door::PackedColor palette[2] = {lowerColor, upperColor};
+ *   std::vector<unsigned char> index(text.length());
+ *
+ *   for (size_t i = 0; i < text.length(); ++i)
+ *     index[i] = std::isupper(text[i]) ? 1 : 0;
+ *   r.build(index.data(), palette);
  *   return r;
  * };
  * ~~~
@@ -490,6 +968,183 @@ typedef std::function<Render(const std::string &)> renderFunction;
  */
 typedef std::function<std::string(void)> updateFunction;
 
+/**
+ * @brief Number of items in a ListMenu
+ */
+typedef std::function<int(void)> countFunction;
+
+/**
+ * @brief Text of an item (0 to count - 1) in a ListMenu
+ */
+typedef std::function<std::string(int)> itemFunction;
+
+/**
+ * @class Observable
+ * A value that tells its observers when it changes.
+ *
+ * subscribe() returns a token.  The observer is called while the token
+ * is held, dropping the token ends the subscription.
+ *
+ * ~~~{.cpp}
+ * door::Observable<int> score(0);
+ *
+ * scoreLine->watch<int>(score, [](const int &s) -> std::string {
+ *   return "Score: " + std::to_string(s);
+ * });
+ *
+ * score = 1200;  // scoreLine is now dirty
+ * screen.update(door);
+ * ~~~
+ *
+ * @brief Observable value
+ */
+template <typename T> class Observable {
+ public:
+  /// Observer function
+  typedef std::function<void(const T &)> observer;
+
+ protected:
+  /// Current value
+  T value;
+  /// Subscribed observers
+  std::vector<std::weak_ptr<observer>> observers;
+
+ public:
+  Observable(const T &v = T()) : value{v} {}
+  Observable(const Observable &) = delete;
+
+  /// Current value
+  const T &get(void) const { return value; };
+  operator const T &(void) const { return value; };
+
+  /**
+   * Set the value, and notify observers if it changed.
+   *
+   * @param v new value
+   * @return Observable&
+   */
+  Observable &operator=(const T &v) {
+    set(v);
+    return *this;
+  };
+
+  /**
+   * Set the value, and notify observers if it changed.
+   *
+   * @param v new value
+   */
+  void set(const T &v) {
+    if (value == v)
+      return;
+    value = v;
+    notify();
+  };
+
+  /**
+   * Call the observers, and forget the ones that unsubscribed.
+   */
+  void notify(void) {
+    size_t keep = 0;
+    // Observers may subscribe while being notified, so don't use iterators.
+    for (size_t i = 0; i < observers.size(); ++i) {
+      std::shared_ptr<observer> o = observers[i].lock();
+      if (o) {
+        (*o)(value);
+        observers[keep++] = observers[i];
+      }
+    }
+    observers.resize(keep);
+  };
+
+  /**
+   * Subscribe to changes.
+   *
+   * @param o observer function
+   * @return std::shared_ptr<void> token, hold it to stay subscribed.
+   */
+  std::shared_ptr<void> subscribe(observer o) {
+    std::shared_ptr<observer> token = std::make_shared<observer>(o);
+    observers.push_back(token);
+    return token;
+  };
+};
+
+/**
+ * BBS color markup.
+ *
+ * - |00 - |15 foreground color (DOS order, 8-15 are bright)
+ * - |16 - |23 background color (DOS order)
+ * - |B0 - |B7 background color (DOS order)
+ * - \@X## PCBoard background/foreground hex attribute
+ * - ^C# (heart code) WWIV colors 0-9
+ *
+ * The markup is compiled into the plain text, and color runs.
+ *
+ * ~~~{.cpp}
+ * door::Line prompt("");
+ * prompt.setMarkup("|14Press |15[|11ENTER|15]|07 to continue");
+ * ~~~
+ */
+Render compileMarkup(const std::string &markup);
+std::shared_ptr<const Render> cachedMarkup(const std::string &markup);
+void clearMarkupCache(void);
+renderFunction markupRender(std::shared_ptr<const Render> compiled);
+
+/**
+ * @class RenderRule
+ * Declarative render function.
+ *
+ * Each byte is colored by a 256 entry table.  Optionally, the menu
+ * option "[X]" at the start of the text is colored by a small bracket
+ * state machine, the same as \ref Menu::makeRender.
+ *
+ * A RenderRule can be used anywhere a renderFunction is, and
+ * Line::setRender(const RenderRule &) uses it without std::function.
+ *
+ * ~~~{.cpp}
+ * door::RenderRule rule(door::ANSIColor(door::COLOR::YELLOW));
+ * rule.upper(door::ANSIColor(door::COLOR::BLUE, door::ATTR::BOLD))
+ *     .digit(door::ANSIColor(door::COLOR::CYAN));
+ * line.setRender(rule);
+ * ~~~
+ *
+ * @brief Render function from character classes
+ */
+class RenderRule {
+  /// Colors used (extended colors are kept)
+  std::vector<ANSIColor> palette;
+  /// Palette index for each byte value
+  unsigned char table[256];
+  /// Use the bracket state machine?
+  bool brackets;
+  /// Color of [ and ]
+  ANSIColor bracketColor;
+  /// Color of the option (inside the brackets)
+  ANSIColor optionColor;
+
+  unsigned char paletteIndex(const ANSIColor &c);
+
+ public:
+  RenderRule(const ANSIColor &other = ANSIColor(COLOR::WHITE, COLOR::BLACK));
+
+  RenderRule &all(const ANSIColor &c);
+  RenderRule &upper(const ANSIColor &c);
+  RenderRule &lower(const ANSIColor &c);
+  RenderRule &digit(const ANSIColor &c);
+  RenderRule &space(const ANSIColor &c);
+  RenderRule &punct(const ANSIColor &c);
+  RenderRule &chars(const char *which, const ANSIColor &c);
+  RenderRule &option(const ANSIColor &bracket, const ANSIColor &option);
+
+  /// Color for byte
+  const ANSIColor &colorOf(unsigned char c) const {
+    return palette[table[c]];
+  };
+  Render operator()(const std::string &txt) const;
+  Render operator()(const char *txt, std::size_t len) const;
+  Render render(const char *txt, std::size_t len, FrameArena *arena) const;
+};
+
 /**
  * @class Clrscr
  * Clear the screen
@@ -610,6 +1265,27 @@ class MultiLine {
 
 #endif
 
+class Panel;
+class Screen;
+
+/**
+ * @brief Columns of a screen row that changed.
+ *
+ * Panels report these to the Screen, which outputs them in row order.
+ */
+struct Damage {
+  /// Screen row
+  int row;
+  /// Screen columns (inclusive)
+  int first, last;
+  /// Panel showing them
+  const Panel *panel;
+  /// Index of the first column in the damaged columns
+  std::size_t cell;
+};
+/// Damage of one Screen::update
+typedef std::vector<Damage, ArenaAllocator<Damage>> Damages;
+
 /**
  * @class Line
  * This holds text and ANSIColor information, and knows how to
@@ -632,11 +1308,94 @@ class Line {
 
   /// renderFunction to use when rendering Line.
   renderFunction render;
+  /// RenderRule to use when rendering Line (instead of render).
+  std::shared_ptr<const RenderRule> rule;
   /// updateFunction to use when updating.
   updateFunction updater;
 
   int width;
 
+  /// Encoded output (colors, padding and text) from the last output.
+  mutable std::string encoded;
+  /// Door color before the encoded output
+  mutable ANSIColor encodedFrom;
+  /// Door color after the encoded output
+  mutable ANSIColor encodedTo;
+  /// Cursor movement of the encoded output
+  mutable int encodedWidth = 0;
+  /// door::unicode when encoded
+  mutable bool encodedUnicode = false;
+  /// Is encoded valid?
+  mutable bool encodedValid = false;
+
+  /// Encoded output of the other render (see swapRender)
+  std::string otherEncoded;
+  /// Door color before and after otherEncoded
+  ANSIColor otherFrom, otherTo;
+  /// Cursor movement of otherEncoded
+  int otherWidth = 0;
+  /// door::unicode when otherEncoded was encoded
+  bool otherUnicode = false;
+  /// Is otherEncoded valid?
+  bool otherValid = false;
+
+  void invalidate(void);
+  void swapEncoded(void);
+  Render renderText(void) const;
+  void encode(std::ostream &os, const Render &r) const;
+
+ public:
+  /**
+   * @brief One column of Line output
+   */
+  struct Cell {
+    /// Character bytes (CP437, or UTF-8 when unicode)
+    char ch[4];
+    /// Number of bytes in ch
+    unsigned char len;
+    /// Color of the column
+    ANSIColor color;
+  };
+  static void appendCells(std::vector<Cell> &out, const char *cp,
+                          const char *end, const ANSIColor &color);
+
+ protected:
+  /// Columns from the last output, used by outputChanges()
+  mutable std::vector<Cell> cells;
+  /// Columns being compared to cells (kept to reuse the memory)
+  std::vector<Cell> nextCells;
+  /// Door color before the columns
+  mutable ANSIColor cellsFrom;
+  void makeCells(std::vector<Cell> &out, const ANSIColor &start,
+                 const Render &r) const;
+
+  /**
+   * @brief Where a Line is shown
+   */
+  struct Placement {
+    /// Panel showing the Line
+    Panel *panel;
+    /// Index of the Line in the Panel, -1 for the title
+    int index;
+  };
+  /// Panels showing this Line
+  std::vector<Placement> placements;
+  /// Has the text changed since it was repainted?
+  bool dirty = false;
+  /// Subscriptions to Observable values
+  std::vector<std::shared_ptr<void>> watching;
+
+  bool changeText(const std::string &newText);
+  void markDirty(void);
+  void repaint(Door &d);
+  /// Positions of a Line (column, row)
+  typedef std::vector<std::pair<int, int>, ArenaAllocator<std::pair<int, int>>>
+      Positions;
+  void outputChanges(Door &d, const Positions &where);
+  void damage(Damages &out, std::vector<Cell> &columns);
+
+  friend class Panel;
+
   /**
    * @param width int
    */
@@ -650,7 +1409,7 @@ class Line {
   Line(const std::string &txt, int width, renderFunction rf);
   Line(const char *txt, int width, renderFunction rf);
   Line(const Line &rhs);
-  Line(Line &&rhs);
+  Line(Line &&rhs) noexcept;
   // ~Line();
 
   bool hasRender(void);
@@ -668,25 +1427,45 @@ class Line {
   void setPadding(const char *padstring, ANSIColor padcolor);
   void setText(std::string &txt);
   void setText(const char *txt);
+  void setMarkup(const std::string &markup);
   const char *getText(void) { return text.c_str(); };
   void setColor(ANSIColor c);
   void setRender(renderFunction rf);
+  void setRender(const RenderRule &rr);
+  void setRender(std::shared_ptr<const RenderRule> rr);
+  void swapRender(renderFunction &other);
+  void swapRender(renderFunction &otherRender,
+                  std::shared_ptr<const RenderRule> &otherRule);
   void setUpdater(updateFunction uf);
   bool update(void);
+  void outputChanges(Door &d, int x, int y);
+
+  /**
+   * Set the text from an Observable value, when it changes.
+   *
+   * The Line is marked dirty, and is output in every Panel showing it
+   * by the next Panel::update(Door &).  The subscription ends when the Line
+   * is destroyed.
+   *
+   * @param value Observable to watch
+   * @param format make the text from the value
+   */
+  template <typename T>
+  void watch(Observable<T> &value,
+             std::function<std::string(const T &)> format) {
+    watching.push_back(value.subscribe([this, format](const T &v) {
+      if (changeText(format(v)))
+        markDirty();
+    }));
+    changeText(format(value.get()));
+  };
 
   std::string debug(void);
 
   /**
-   * @todo This might be a problem, because const Line wouldn't
-   * allow me to track "updates".  I.E.  I send the line, I'd
-   * need to change the line's State to "nothing changed".
-   * Then, if something did change, the next update request would
-   * be able to know that yes, this does indeed need to be sent.
-   *
-   * @bug This also might cause problems if I display a shared
-   * BasicLine (in multiple places), and then update it.  It
-   * would only update in the first place (the others wouldn't
-   * show it needs an update).
+   * Changes are tracked by the Line being marked dirty (see
+   * Line::markDirty), and a Line shown in several panels is
+   * repainted in all of them (see Line::repaint).
    */
   friend std::ostream &operator<<(std::ostream &os, const Line &l);
 };
@@ -774,12 +1553,9 @@ class Panel {
   BorderStyle border_style;
   ANSIColor border_color;
   /**
-   * @todo Fix this to use shared_ptr.
-   * I don't think unique_ptr is the right way to go with this.  I want to reuse
-   * things, and that means shared_ptr!
-   *
+   * Lines are shared, the same Line can be shown in more than one Panel.
    */
-  std::vector<std::unique_ptr<Line>> lines;
+  std::vector<std::shared_ptr<Line>> lines;
   bool hidden;
   // when you show panel, should it mark it as
   // redisplay everything??  maybe??
@@ -787,13 +1563,95 @@ class Panel {
   std::unique_ptr<Line> title;
   int offset;
 
+  /// Indexes of dirty lines
+  std::vector<int> dirtyLines;
+  /// Indexes of lines with updaters
+  std::vector<int> polled;
+  /// Is polled up to date?
+  bool polledValid = false;
+  void findPolled(void);
+  void linePosition(int index, int &col, int &row) const;
+
+  /// Join type of each line (spacer lines), -1 for none
+  mutable std::vector<signed char> joins;
+  /// Are joins up to date with the line text?
+  mutable bool joinsValid = false;
+  /// door::unicode of the joins
+  mutable bool joinsUnicode = false;
+  void findJoins(void) const;
+  /// Top border
+  mutable std::string stripTop;
+  /// Bottom border
+  mutable std::string stripBottom;
+  /// Border top character, width times
+  mutable std::string stripHorizontal;
+  /// Width of the border strings
+  mutable int stripWidth = -1;
+  /// Style of the border strings
+  mutable BorderStyle stripStyle = BorderStyle::NONE;
+  /// door::unicode of the border strings
+  mutable bool stripUnicode = false;
+  void borderStrips(void) const;
+  void outputTop(std::ostream &os) const;
+  void beginRow(std::ostream &os, int row, bool border) const;
+  void endRow(std::ostream &os, bool border) const;
+  bool scrollRows(Door &d, int count, int lines);
+  static void outputCells(std::ostream &os,
+                          const std::vector<Line::Cell> &cells);
+
+  /**
+   * @brief A Line with an updater, inside the image
+   *
+   * It is output again each time the image is used.
+   */
+  struct ImageSpan {
+    /// Index of the Line
+    int index;
+    /// Byte offsets of the Line's output in image
+    std::size_t start, end;
+    /// Door color before and after the Line
+    ANSIColor from, to;
+    /// Cursor position before the Line
+    int cx, cy;
+  };
+  /// Encoded output of the last full draw
+  mutable std::string image;
+  /// Lines with updaters in the image
+  mutable std::vector<ImageSpan> imageSpans;
+  /// Door color before and after the image
+  mutable ANSIColor imageFrom, imageTo;
+  /// Cursor position after the image
+  mutable int imageX = 1, imageY = 1;
+  /// door::unicode when the image was made
+  mutable bool imageUnicode = false;
+  /// Is the image valid?
+  mutable bool imageValid = false;
+  void draw(std::ostream &os) const;
+
+  /// Screen showing the Panel
+  Screen *screen = nullptr;
+  /// Is part of the Panel covered by another Panel on the Screen?
+  bool occluded = false;
+  void restacked(void);
+  void rowCells(int row, std::vector<Line::Cell> &out) const;
+  virtual void lineCells(int index, std::vector<Line::Cell> &out) const;
+  virtual void damage(Damages &out, std::vector<Line::Cell> &columns);
+
+  /// Number of rows of lines (without borders)
+  virtual int rowCount(void) const { return lines.size(); };
+
+  friend class Line;
+  friend class Screen;
+
  public:
   Panel(int x, int y, int width);
   Panel(int width);
 
   // Panel(const Panel &);
   Panel(Panel &) = delete;  // default;
-  Panel(Panel &&ref);
+  Panel(Panel &&ref) noexcept;
+  virtual ~Panel();
+  virtual void output(std::ostream &os) const;
 
   void set(int x, int y);
   void get(int &x, int &y) {
@@ -804,16 +1662,17 @@ class Panel {
   void setTitle(std::unique_ptr<Line> T, int off = 1);
   void setStyle(BorderStyle bs);
   void setColor(ANSIColor c);
+  void frame(int &left, int &top, int &right, int &bottom) const;
   int getWidth(void) { return width; };
   int getHeight(void) {
     if (border_style == BorderStyle::NONE)
-      return lines.size();
+      return rowCount();
     else
-      return lines.size() + 2;
+      return rowCount() + 2;
   };
   void hide(void);
   void show(void);
-  void addLine(std::unique_ptr<Line> l);
+  void addLine(std::shared_ptr<Line> l);
   // bool delLine(std::shared_ptr<Line> l); // ?
   /*
   void display(void);
@@ -830,15 +1689,93 @@ class Panel {
    * @return true
    * @return false
    */
-  bool update(Door &d);
+  virtual bool update(Door &d);
   void update(Door &d, int line);
-  void update(void);
+  virtual void update(void);
   door::Goto gotoEnd(void);
   std::unique_ptr<Line> spacer_line(bool single);
   void lineSetBack(ANSIColor back);
   friend std::ostream &operator<<(std::ostream &os, const Panel &p);
 };
 
+/**
+ * @class PackedPanel
+ * Panel with contiguous line storage, for panels with many lines
+ * (scores, file lists).
+ *
+ * Lines are stored as arrays: the text of all lines in one pool, with
+ * the offset, length, columns, color and RenderRule of each line.
+ * Only the rows from the top line are shown.
+ *
+ * ~~~{.cpp}
+ * door::PackedPanel scores(5, 5, 30, 10);
+ * int rule = scores.addRule(door::RenderRule(yellow).digit(white));
+ * for (auto &score : all_scores)
+ *   scores.append(score.text, yellow, rule);
+ * door << scores;
+ * ~~~
+ *
+ * @brief Panel with structure of arrays line storage
+ */
+class PackedPanel : public Panel {
+ protected:
+  /// Text of all lines
+  std::string pool;
+  /// Offset of each line in pool
+  std::vector<std::uint32_t> starts;
+  /// Length (bytes) of each line
+  std::vector<std::uint32_t> lengths;
+  /// Bytes of pool each line can use (its slot, at least the length)
+  std::vector<std::uint32_t> capacities;
+  /// Bytes of pool no longer used by any line
+  std::size_t abandoned = 0;
+  /// Columns of each line
+  std::vector<std::uint32_t> columns;
+  /// Color of each line
+  std::vector<PackedColor> colors;
+  /// RenderRule of each line, or NO_RULE
+  std::vector<std::uint16_t> ruleIndex;
+  /// RenderRules used by lines
+  std::vector<RenderRule> rules;
+  /// First line shown
+  int top;
+  /// Number of rows shown
+  int rows;
+  /// Lines changed since the last update
+  std::vector<int> changed;
+
+  int rowCount(void) const override;
+  void compact(void);
+  void outputRow(std::ostream &os, int line) const;
+  void lineCells(int index, std::vector<Line::Cell> &out) const override;
+  void damage(Damages &out, std::vector<Line::Cell> &columns) override;
+
+ public:
+  /// ruleIndex value of lines without a RenderRule
+  static const std::uint16_t NO_RULE = 0xffff;
+
+  PackedPanel(int x, int y, int width, int rows);
+
+  /// Lines live in the pool, use append.
+  void addLine(std::shared_ptr<Line> l) = delete;
+  int addRule(const RenderRule &rule);
+  void append(const std::string &text, PackedColor color, int rule = -1);
+  void setText(int line, const std::string &text);
+  void clear(void);
+
+  /// Number of lines
+  int size(void) const { return starts.size(); };
+  std::string getText(int line) const;
+  int widest(void) const;
+  void scroll(int line);
+  /// First line shown
+  int getTop(void) const { return top; };
+
+  bool update(Door &d) override;
+  void update(void) override{};
+  void output(std::ostream &os) const override;
+};
+
 /*
 Menu - defaults to double lines.
 Has colorize for selected item / non-selected.
@@ -853,12 +1790,62 @@ Remaining LC text = c4
 // Colors for CS and CU (color selected, color unselected)
  */
 
+/**
+ * @class PrefixIndex
+ * Sorted option text, for type-ahead search in menus.
+ *
+ * Each typed character narrows the range of matching options with a
+ * binary search on that character, as the options with the same prefix
+ * are next to each other.  Matching ignores case.
+ *
+ * @brief Type-ahead search
+ */
+class PrefixIndex {
+  /// Lower case text and item, sorted
+  std::vector<std::pair<std::string, int>> keys;
+  bool sorted = true;
+  /// Typed so far
+  std::string prefix;
+  /// Matching keys [first, last)
+  std::size_t first = 0;
+  std::size_t last = 0;
+
+ public:
+  void add(const std::string &text, int item);
+  void clear(void);
+  void reset(void);
+  bool narrow(char c);
+  bool back(void);
+  int match(void) const;
+  /// Number of items in the index
+  std::size_t size(void) const { return keys.size(); };
+  /// Number of items matching the prefix
+  std::size_t matches(void) const { return last - first; };
+  /// Typed so far
+  const std::string &getPrefix(void) const { return prefix; };
+};
+
 class Menu : public Panel {
  protected:
   unsigned int chosen;
   std::vector<char> options;
+  /// Option text, for type-ahead
+  PrefixIndex search;
   renderFunction selectedRender;
   renderFunction unselectedRender;
+  /// RenderRule for selected lines (used instead of selectedRender)
+  std::shared_ptr<const RenderRule> selectedRule;
+  /// RenderRule for unselected lines (used instead of unselectedRender)
+  std::shared_ptr<const RenderRule> unselectedRule;
+  /// Option for each key (upper case), -1 for none
+  std::array<int, 256> hotkeys;
+  /// Do 8 and 2 move the selection (when they aren't options)?
+  bool use_numberpad = true;
+  /// Line with the selected render, -1 when the lines need their renders
+  int rendered = -1;
+  void addOption(char c, const char *line);
+  void renderLines(void);
+  void selectLine(unsigned int index);
   /*
   std::function<void(Door &d, std::string &)> selectedColorizer;
   std::function<void(Door &d, std::string &)> unselectedColorizer;
@@ -867,6 +1854,10 @@ class Menu : public Panel {
  public:
   static renderFunction defaultSelectedRender;
   static renderFunction defaultUnselectedRender;
+  /// RenderRule new Menus use for the selected line
+  static std::shared_ptr<const RenderRule> defaultSelectedRule;
+  /// RenderRule new Menus use for unselected lines
+  static std::shared_ptr<const RenderRule> defaultUnselectedRule;
   /*
   static std::function<void(Door &d, std::string &)> defaultSelectedColorizer;
   static std::function<void(Door &d, std::string &)> defaultUnselectedColorizer;
@@ -876,28 +1867,244 @@ class Menu : public Panel {
   Menu(int width);
   // Menu(const Menu &);
   Menu(const Menu &) = delete;
-  Menu(Menu &&);
+  Menu(Menu &&) noexcept;
 
   void addSelection(char c, const char *line);
   void addSelection(char c, const char *line, updateFunction update);
   void defaultSelection(int d);
   void setRender(bool selected, renderFunction render);
+  void setRender(bool selected, const RenderRule &rule);
 
   int choose(Door &door);
   char which(int d);
 
+  static RenderRule makeRule(ANSIColor c1, ANSIColor c2, ANSIColor c3,
+                             ANSIColor c4);
   static renderFunction makeRender(ANSIColor c1, ANSIColor c2, ANSIColor c3,
                                    ANSIColor c4);
 };
 
+/**
+ * @class ListMenu
+ * A Menu for very long lists (files, players).
+ *
+ * The items come from a data source (count and item(i)), only the
+ * visible rows are asked for and output.  Moving the selection out of
+ * the window scrolls it.  When the terminal can scroll (scroll_region)
+ * and the menu is the full screen width, the rows are scrolled by the
+ * terminal and only the new rows are output.  Otherwise only the rows
+ * that changed are output.
+ *
+ * @brief Virtual list menu
+ */
+class ListMenu : public Panel {
+ protected:
+  countFunction count;
+  itemFunction item;
+  /// Visible rows
+  int rows;
+  /// First item shown
+  int top = 0;
+  /// Selected item
+  int chosen = 0;
+  renderFunction selectedRender;
+  renderFunction unselectedRender;
+  /// Item for each key, -1 for none
+  std::array<int, 256> hotkeys;
+  /// Item text, for type-ahead (built when first used)
+  PrefixIndex search;
+  /// Is search up to date with the items?
+  bool indexed = false;
+
+  /// Text of each row, as output
+  mutable std::vector<std::string> shown;
+  /// State of each row, as output: 1 selected, 0 not, -1 needs output
+  mutable std::vector<signed char> shownState;
+  /// Row text being compared to shown (kept to reuse the memory)
+  std::string next;
+
+  int rowCount(void) const override { return rows; };
+  void rowText(int row, int total, std::string &text) const;
+  void outputRow(std::ostream &os, int row, bool border) const;
+  void lineCells(int index, std::vector<Line::Cell> &out) const override;
+  void repaint(Door &d);
+  bool hardwareScroll(Door &d, int lines);
+  void indexItems(void);
+  int clampChosen(void);
+
+ public:
+  ListMenu(int x, int y, int width, int rows, countFunction count,
+           itemFunction item);
+
+  void setHotkey(unsigned char key, int item);
+  void setRender(bool selected, renderFunction render);
+  void select(int item);
+  void invalidate(void);
+  /// Selected item
+  int getChosen(void) const { return chosen; };
+  /// First item shown
+  int getTop(void) const { return top; };
+
+  int choose(Door &door);
+  bool move(Door &d, int item);
+  void output(std::ostream &os) const override;
+};
+
+/**
+ * @class LogPanel
+ * A scrolling log (or ticker) of the last lines added.
+ *
+ * New lines are added at the bottom, and the older ones scroll up.  When
+ * the terminal can scroll (scroll_region) and the panel is the full
+ * screen width, the terminal scrolls the rows and only the new row is
+ * output.  Otherwise only the rows that changed are output.
+ *
+ * The last lines are kept in a ring, so the panel can be output again.
+ *
+ * @brief Scrolling log panel
+ */
+class LogPanel : public Panel {
+ protected:
+  /// Visible rows
+  int rows;
+  /// Lines kept, line n is history[n % history.size()]
+  std::vector<std::string> history;
+  /// Lines added
+  long added = 0;
+  ANSIColor textColor;
+
+  /// Text of each row, as output
+  mutable std::vector<std::string> shown;
+  /// Row text being compared to shown (kept to reuse the memory)
+  std::string next;
+
+  int rowCount(void) const override { return rows; };
+  void rowText(int row, std::string &text) const;
+  void outputRow(std::ostream &os, int row, bool border) const;
+  void lineCells(int index, std::vector<Line::Cell> &out) const override;
+  void repaint(Door &d);
+  bool hardwareScroll(Door &d);
+
+ public:
+  LogPanel(int x, int y, int width, int rows, int keep = 0);
+
+  void setTextColor(ANSIColor c);
+  void add(const std::string &text);
+  void append(Door &d, const std::string &text);
+  void output(std::ostream &os) const override;
+};
+
+/**
+ * @class WrapPanel
+ * Paragraphs of color markup, word wrapped to the panel width.
+ *
+ * Each paragraph keeps where its lines break, for the width they were
+ * wrapped to.  Changing a paragraph, or the width, only wraps the
+ * paragraphs that need it again, and only when they are next shown.
+ * Drawing uses the kept breaks, and doesn't wrap anything.
+ *
+ * ~~~{.cpp}
+ * door::WrapPanel help(2, 2, 60, 18);
+ * help.addParagraph("|15Welcome|07 to the game.  Your ship ...");
+ * help.addParagraph("");
+ * door << help;
+ * ~~~
+ *
+ * @brief Word wrapped text panel
+ */
+class WrapPanel : public Panel {
+ protected:
+  /**
+   * @brief A paragraph, and where it breaks into lines
+   */
+  struct Paragraph {
+    /// Text, without the markup
+    std::string text;
+    /// Color runs
+    std::vector<ColorOutput> runs;
+    /// Columns of the text, on one line
+    int columns = 0;
+    /// Start of each line
+    std::vector<int> breaks;
+    /// Width the breaks are for (0 for not wrapped)
+    int wrapped = 0;
+    /// door::unicode the columns and breaks are for
+    bool unicode = false;
+  };
+  /// Paragraphs (the breaks are updated when they are shown)
+  mutable std::vector<Paragraph> paragraphs;
+  /// First line of each paragraph, and the line count at the end
+  mutable std::vector<int> firstLines;
+  /// firstLines is out of date
+  mutable bool reflow = true;
+  /// door::unicode of firstLines
+  mutable bool layoutUnicode = false;
+  /// Visible rows
+  int rows;
+  /// First line shown
+  int top = 0;
+  /// First line shown, as output (-1 for none)
+  mutable int shownTop = -1;
+
+  static void wrap(Paragraph &p, int width);
+  void layout(void) const;
+  void lineRange(int line, int &para, int &start, int &end) const;
+  int rowCount(void) const override { return rows; };
+  void lineCells(int index, std::vector<Line::Cell> &out) const override;
+  void outputRow(std::ostream &os, int row, bool border) const;
+
+ public:
+  WrapPanel(int x, int y, int width, int rows);
+
+  void addParagraph(const std::string &markup);
+  void setParagraph(int index, const std::string &markup);
+  void setWidth(int width);
+  int lineCount(void) const;
+  /// First line shown
+  int getTop(void) const { return top; };
+
+  bool scroll(Door &d, int line);
+  void output(std::ostream &os) const override;
+};
+
 class Screen {
  protected:
   // bool hidden;
   /**
    * @brief vector of panels.
+   *
+   * This is the z-order, the last Panel is on top.
    */
   std::vector<std::unique_ptr<Panel>> panels;
 
+  /// Column ranges (first, last) of a row
+  typedef std::vector<std::pair<int, int>, ArenaAllocator<std::pair<int, int>>>
+      Spans;
+  std::size_t indexOf(const Panel *p) const;
+  bool covered(std::size_t index) const;
+  /// Is occluded up to date for every panel?
+  bool stackValid = false;
+  void restack(void);
+  void visibleSpans(std::size_t index, int row, int left, int right,
+                    Spans &out) const;
+  void paintSpans(std::ostream &os, std::size_t index, int row,
+                  const Spans &spans) const;
+  void paintLine(Door &d, const Panel &p, int index) const;
+  static void cutSpans(Spans &spans, int from, int to);
+  void output(std::ostream &os) const;
+  /// Columns of the row being painted
+  mutable std::vector<Line::Cell> cells;
+  /// Changed columns reported by the panels (see Damage)
+  std::vector<Line::Cell> damaged;
+
+  friend class Line;
+  friend class Panel;
+  friend class PackedPanel;
+  friend class ListMenu;
+  friend class LogPanel;
+  friend class FileViewer;
+  friend class WrapPanel;
+
  public:
   Screen(void);
   Screen(Screen &) = default;
@@ -911,9 +2118,170 @@ void show(void);
   bool update(Door &d);
   void update(void);
 
+  void paint(std::ostream &os, int left, int top, int right, int bottom) const;
+  void hide(Door &d, Panel *p);
+  void show(Door &d, Panel *p);
+  void move(Door &d, Panel *p, int x, int y);
+  std::unique_ptr<Panel> close(Door &d, Panel *p);
+
   friend std::ostream &operator<<(std::ostream &os, const Screen &s);
 };
 
+/**
+ * @class MappedFile
+ * A read-only memory mapped file.
+ *
+ * @brief mmap a file
+ */
+class MappedFile {
+  const char *start;
+  std::size_t length;
+
+ public:
+  MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  bool open(const char *filename);
+  void close(void);
+  /// Start of the file
+  const char *data(void) const { return start; };
+  /// Size of the file in bytes
+  std::size_t size(void) const { return length; };
+};
+
+/**
+ * @brief SGR (color) state, while decoding ANSI.
+ *
+ * fg is COLOR + 8 for bright (from 90-97 or 38).
+ */
+struct SGRState {
+  std::uint8_t fg = (std::uint8_t)COLOR::WHITE;
+  std::uint8_t bg = (std::uint8_t)COLOR::BLACK;
+  bool bold = false;
+  bool blink = false;
+  bool inverse = false;
+
+  void apply(const int *params, int count, bool ice);
+  PackedColor color(void) const;
+};
+
+/**
+ * @class ANSIArt
+ * This decodes ANSI art (.ANS) into a grid of cells, and sends
+ * it out again using the fewest color changes and cursor moves.
+ *
+ * SAUCE records are used for the width and iCE colors.
+ *
+ * ~~~{.cpp}
+ * door::ANSIArt art;
+ * if (art.load("welcome.ans"))
+ *   door << door::reset << door::cls << art;
+ * ~~~
+ *
+ * @brief ANSI art
+ */
+class ANSIArt {
+ public:
+  /// One character on the screen (CP437) and its color.
+  struct Cell {
+    unsigned char ch;
+    PackedColor color;
+  };
+
+ protected:
+  int x;
+  int y;
+  int width;
+  int height;
+  bool ice;
+  bool skip_blanks;
+  std::vector<Cell> cells;
+
+ public:
+  ANSIArt();
+
+  bool load(const char *filename);
+  void decode(const char *data, std::size_t length);
+  void clear(void);
+
+  void set(int x, int y);
+  /**
+   * When set, blank (black) space is skipped with cursor moves instead
+   * of being sent.  This assumes the screen (under the art) is clear.
+   * This is the default.
+   */
+  void setSkipBlanks(bool skip) { skip_blanks = skip; };
+  int getWidth(void) const { return width; };
+  int getHeight(void) const { return height; };
+  /// iCE colors (blink is bright background)
+  bool iceColors(void) const { return ice; };
+  const Cell &cell(int col, int row) const { return cells[row * width + col]; };
+
+  friend std::ostream &operator<<(std::ostream &os, const ANSIArt &art);
+};
+
+/**
+ * @class FileViewer
+ * A pager for text and ANSI files (bulletins, instructions, logs).
+ *
+ * The file is memory mapped, and only the visible rows are decoded.  The
+ * start of each line (and the color there) is indexed as the viewer
+ * scrolls down, so opening a large file doesn't read it.  Colors (SGR)
+ * and cursor forward are kept, other escape codes are ignored.
+ * Characters are CP437.
+ *
+ * ~~~{.cpp}
+ * door::FileViewer viewer(1, 1, 78, 22);
+ * if (viewer.load("bulletin.ans"))
+ *   viewer.view(door);
+ * ~~~
+ *
+ * @brief File viewer
+ */
+class FileViewer : public Panel {
+ protected:
+  MappedFile file;
+  /// Length of the text (without SAUCE, or up to EOF)
+  mutable std::size_t length = 0;
+  bool ice = false;
+  /// Lines wrap at this width (SAUCE width, or 80)
+  int wrap = 80;
+  /// Visible rows
+  int rows;
+  /// First line shown
+  int top = 0;
+  /// First line shown, as output (-1 for none)
+  mutable int shownTop = -1;
+
+  /// Start of each line indexed so far
+  mutable std::vector<std::size_t> starts;
+  /// Color at the start of each line
+  mutable std::vector<SGRState> pens;
+  /// The whole file has been indexed
+  mutable bool indexed = false;
+
+  const char *wrapLine(const char *cp, const char *nl, SGRState &pen) const;
+  bool indexTo(int line) const;
+  int rowCount(void) const override { return rows; };
+  void lineCells(int index, std::vector<Line::Cell> &out) const override;
+  void outputRow(std::ostream &os, int row, bool border) const;
+  bool hardwareScroll(Door &d, int lines);
+
+ public:
+  FileViewer(int x, int y, int width, int rows);
+
+  bool load(const char *filename);
+  int lineCount(void) const;
+  /// First line shown
+  int getTop(void) const { return top; };
+
+  bool scroll(Door &d, int line);
+  int view(Door &door);
+  void output(std::ostream &os) const override;
+};
+
 /*
 screen - contains panels.
   - default to 1,1 X 80,24
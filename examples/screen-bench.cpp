@@ -0,0 +1,147 @@
+#include "door.h"
+#include <chrono>
+#include <iostream>
+
+/*
+ * Status screen benchmark.
+ *
+ * A screen of status panels (2 x 3), each with 8 polled lines.  Every
+ * frame the turn counters and a few of the values change.  The changes
+ * are output by each Panel::update (in panel order), and by
+ * Screen::update (in row order).
+ *
+ * The output is captured (door::debug_capture), and the bytes, Gotos
+ * and time per frame are reported.
+ *
+ * ./screen-bench -l
+ */
+
+const int COLUMNS = 2;
+const int ROWS = 3;
+const int LINES = 8;
+const int FRAMES = 20000;
+
+/**
+ * Build the status screen.
+ *
+ * @param screen Screen
+ * @param panels the panels, in the order they were added
+ * @param values value shown by each line
+ */
+void build(door::Screen &screen, std::vector<door::Panel *> &panels,
+           std::vector<int> &values) {
+  values.assign(COLUMNS * ROWS * LINES, 0);
+
+  for (int r = 0; r < ROWS; ++r) {
+    for (int c = 0; c < COLUMNS; ++c) {
+      int first = (r * COLUMNS + c) * LINES;
+      std::unique_ptr<door::Panel> panel =
+          std::make_unique<door::Panel>(1 + c * 40, 1 + r * (LINES + 2), 38);
+      panel->setStyle(door::BorderStyle::SINGLE);
+      panel->setColor(door::ANSIColor(door::COLOR::CYAN, door::COLOR::BLUE));
+
+      for (int l = 0; l < LINES; ++l) {
+        int *value = &values[first + l];
+        door::updateFunction text = [value, l](void) -> std::string {
+          return "Stat " + std::to_string(l) + ": " + std::to_string(*value);
+        };
+        std::unique_ptr<door::Line> line = std::make_unique<door::Line>(
+            text(), 38,
+            door::ANSIColor(door::COLOR::YELLOW, door::COLOR::BLUE,
+                            door::ATTR::BOLD));
+        line->setUpdater(text);
+        panel->addLine(std::move(line));
+      }
+      panels.push_back(panel.get());
+      screen.addPanel(std::move(panel));
+    }
+  }
+}
+
+/**
+ * Count the Gotos in the output.
+ *
+ * @param output
+ * @return int
+ */
+int moves(const std::string &output) {
+  int count = 0;
+  std::size_t pos = 0;
+  while ((pos = output.find("\x1b[", pos)) != std::string::npos) {
+    pos += 2;
+    while ((pos < output.length()) and
+           (isdigit(output[pos]) or (output[pos] == ';')))
+      ++pos;
+    if ((pos < output.length()) and (output[pos] == 'H'))
+      ++count;
+  }
+  return count;
+}
+
+/**
+ * Change some of the values, the same ones for each run.
+ *
+ * The first line of every panel is a turn counter, and changes every
+ * frame.  A few other lines change too.
+ *
+ * @param values
+ * @param frame
+ */
+void change(std::vector<int> &values, int frame) {
+  for (std::size_t first = 0; first < values.size(); first += LINES)
+    values[first] = frame;
+  for (int i = 0; i < 4; ++i) {
+    int pick = (frame * 7 + i * 13) % values.size();
+    values[pick] += frame % 3 + 1;
+  }
+}
+
+/**
+ * Run the frames, report the output and time.
+ *
+ * @param door Door
+ * @param name
+ * @param byScreen use Screen::update, instead of each Panel::update
+ */
+void run(door::Door &door, const char *name, bool byScreen) {
+  door::Screen screen;
+  std::vector<door::Panel *> panels;
+  std::vector<int> values;
+  build(screen, panels, values);
+
+  door << screen;
+  door.debug_buffer.clear();
+
+  std::size_t bytes = 0;
+  long gotos = 0;
+  std::chrono::nanoseconds elapsed(0);
+
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    change(values, frame);
+    auto start = std::chrono::steady_clock::now();
+    if (byScreen)
+      screen.update(door);
+    else {
+      for (door::Panel *panel : panels)
+        panel->update(door);
+    }
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    bytes += door.debug_buffer.length();
+    gotos += moves(door.debug_buffer);
+    door.debug_buffer.clear();
+  }
+
+  std::cout << name << ": " << (double)bytes / FRAMES << " bytes, "
+            << (double)gotos / FRAMES << " Gotos, "
+            << (double)elapsed.count() / FRAMES << " ns per frame"
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  door::debug_capture = true;
+  door::Door door("screen-bench", argc, argv);
+
+  run(door, "Panel::update ", false);
+  run(door, "Screen::update", true);
+}
@@ -1,5 +1,6 @@
 #include "door.h"
 #include "utf8.h"
+#include <cstring>
 
 /**
  * @file
@@ -134,13 +135,14 @@ Line::Line(const char *txt, int w, ANSIColor c)
 }
 
 Line::Line(const std::string &txt, int w, renderFunction rf)
-    : text{txt}, render{rf}, width{w} {
+    : text{txt}, width{w} {
   hasColor = false;
+  setRender(rf);
 }
 
-Line::Line(const char *txt, int w, renderFunction rf)
-    : text{txt}, render{rf}, width{w} {
+Line::Line(const char *txt, int w, renderFunction rf) : text{txt}, width{w} {
   hasColor = false;
+  setRender(rf);
 }
 
 /**
@@ -164,20 +166,31 @@ Line::Line(const Line &rhs)
   if (rhs.render) {
     render = rhs.render;
   }
+  rule = rhs.rule;
   if (rhs.updater) {
     updater = rhs.updater;
   }
   width = rhs.width;
 }
 
-Line::Line(Line &&rhs)
-    : text{rhs.text}, hasColor{rhs.hasColor}, color{rhs.color},
-      padding{rhs.padding}, paddingColor{rhs.paddingColor} {
-  if (rhs.render)
-    render = rhs.render;
-  if (rhs.updater)
-    updater = rhs.updater;
-  width = rhs.width;
+/**
+ * Move a Line.
+ *
+ * Panels and Observable values refer to the original Line, so its
+ * placements and subscriptions stay with it.
+ *
+ * @param rhs Line&&
+ */
+Line::Line(Line &&rhs) noexcept
+    : text{std::move(rhs.text)}, hasColor{rhs.hasColor}, color{rhs.color},
+      padding{std::move(rhs.padding)}, paddingColor{rhs.paddingColor},
+      render{std::move(rhs.render)}, rule{std::move(rhs.rule)},
+      updater{std::move(rhs.updater)}, width{rhs.width},
+      encoded{std::move(rhs.encoded)}, encodedFrom{rhs.encodedFrom},
+      encodedTo{rhs.encodedTo}, encodedWidth{rhs.encodedWidth},
+      encodedUnicode{rhs.encodedUnicode}, encodedValid{rhs.encodedValid},
+      cells{std::move(rhs.cells)}, cellsFrom{rhs.cellsFrom} {
+  rhs.encodedValid = false;
 }
 
 /**
@@ -186,7 +199,7 @@ Line::Line(Line &&rhs)
  * @return bool
  */
 bool Line::hasRender(void) {
-  if (render) {
+  if (render or rule) {
     return true;
   } else {
     return false;
@@ -232,7 +245,8 @@ void Line::fit(void) {
   need -= padding.length() * 2;
 
   if (need > 0) {
-    text.append(std::string(need, ' '));
+    text.append(need, ' ');
+    invalidate();
   }
 }
 
@@ -240,12 +254,35 @@ void Line::fit(void) {
  * Set Line text.
  * @param txt std::string
  */
-void Line::setText(std::string &txt) { text = txt; }
+void Line::setText(std::string &txt) {
+  text = txt;
+  invalidate();
+}
 /**
  * Set Line text.
  * @param txt const char *
  */
-void Line::setText(const char *txt) { text = txt; }
+void Line::setText(const char *txt) {
+  text = txt;
+  invalidate();
+}
+
+/**
+ * Set Line text from BBS color markup.
+ *
+ * The markup is compiled once (and cached), the Line text is set to the
+ * plain text, and the render function uses the compiled color runs.
+ *
+ * @see compileMarkup
+ * @param markup std::string
+ */
+void Line::setMarkup(const std::string &markup) {
+  std::shared_ptr<const Render> compiled = cachedMarkup(markup);
+  text.assign(compiled->getText().data(), compiled->getText().length());
+  render = markupRender(compiled);
+  rule.reset();
+  invalidate();
+}
 
 /**
  * set padding (color and text)
@@ -256,6 +293,7 @@ void Line::setText(const char *txt) { text = txt; }
 void Line::setPadding(std::string &padstring, ANSIColor padColor) {
   padding = padstring;
   paddingColor = padColor;
+  invalidate();
 }
 
 /**
@@ -267,14 +305,20 @@ void Line::setPadding(std::string &padstring, ANSIColor padColor) {
 void Line::setPadding(const char *padstring, ANSIColor padColor) {
   padding = padstring;
   paddingColor = padColor;
+  invalidate();
 }
 
 /**
  * set color
  *
+ * BarLine sets the color on every update, so the encoded output is
+ * only invalidated when the color actually changes.
+ *
  * @param c ANSIColor
  */
 void Line::setColor(ANSIColor c) {
+  if (!hasColor or (color != c))
+    invalidate();
   color = c;
   hasColor = true;
 }
@@ -283,10 +327,95 @@ void Line::setColor(ANSIColor c) {
  * set render
  *
  * Set the renderFunction to use for this Line.  This
- * replaces the colorizer.
+ * replaces the colorizer.  A renderFunction made from a RenderRule uses
+ * the rule directly.
  * @param rf renderFunction
  */
-void Line::setRender(renderFunction rf) { render = rf; }
+void Line::setRender(renderFunction rf) {
+  const RenderRule *rr = rf.target<RenderRule>();
+  if (rr != nullptr) {
+    setRender(*rr);
+    return;
+  }
+  render = rf;
+  rule.reset();
+  invalidate();
+}
+
+/**
+ * swap render function
+ *
+ * The render function is exchanged with other.  The encoded output of
+ * each is kept, so switching back and forth (menu selections) doesn't
+ * render the text again.
+ *
+ * @param other renderFunction
+ */
+void Line::swapRender(renderFunction &other) {
+  if (rule) {
+    rule.reset();
+    render = nullptr;
+    invalidate();
+  }
+  render.swap(other);
+  swapEncoded();
+}
+
+/**
+ * swap render function and rule
+ *
+ * Both are exchanged with the others, and the encoded output of each is
+ * kept, see swapRender(renderFunction &).
+ *
+ * @param otherRender renderFunction
+ * @param otherRule RenderRule (used instead of otherRender, when set)
+ */
+void Line::swapRender(renderFunction &otherRender,
+                      std::shared_ptr<const RenderRule> &otherRule) {
+  render.swap(otherRender);
+  rule.swap(otherRule);
+  swapEncoded();
+}
+
+/**
+ * Exchange the encoded output with the other render's.
+ */
+void Line::swapEncoded(void) {
+  std::swap(encoded, otherEncoded);
+  std::swap(encodedFrom, otherFrom);
+  std::swap(encodedTo, otherTo);
+  std::swap(encodedWidth, otherWidth);
+  std::swap(encodedUnicode, otherUnicode);
+  std::swap(encodedValid, otherValid);
+
+  if (!updater) {
+    for (auto &p : placements)
+      p.panel->imageValid = false;
+  }
+}
+
+/**
+ * set render rule
+ *
+ * The RenderRule is used directly, without going through a
+ * renderFunction.
+ * @param rr RenderRule
+ */
+void Line::setRender(const RenderRule &rr) {
+  setRender(std::make_shared<const RenderRule>(rr));
+}
+
+/**
+ * set shared render rule
+ *
+ * Lines can share one RenderRule (menus).
+ * @param rr RenderRule
+ */
+void Line::setRender(std::shared_ptr<const RenderRule> rr) {
+  rule = std::move(rr);
+  render = nullptr;
+  invalidate();
+}
 
 /**
  * set updater function
@@ -295,7 +424,13 @@ void Line::setRender(renderFunction rf) { render = rf; }
  * @todo Define an updateFunction.
  * @param newUpdater updateFunction
  */
-void Line::setUpdater(updateFunction newUpdater) { updater = newUpdater; }
+void Line::setUpdater(updateFunction newUpdater) {
+  updater = newUpdater;
+  for (const Placement &p : placements) {
+    p.panel->polledValid = false;
+    p.panel->imageValid = false;
+  }
+}
 
 std::string Line::debug(void) {
   std::string desc;
@@ -306,71 +441,415 @@ std::string Line::debug(void) {
   if (updater) {
     desc += "[U]";
   }
-  if (render) {
+  if (render or rule) {
     desc += "[R]";
   }
   return desc;
 }
+/**
+ * Change the text, padded to the width.
+ *
+ * The padded text is built in place, reusing the memory of the old text.
+ *
+ * @param newText std::string
+ * @return bool was the text changed?
+ */
+bool Line::changeText(const std::string &newText) {
+  int need;
+  if (unicode) {
+    need = width - utf8::distance(newText.begin(), newText.end());
+  } else {
+    need = width - newText.length();
+  }
+
+  need -= padding.length() * 2;
+  if (need < 0)
+    need = 0;
+
+  size_t length = newText.length();
+  if ((text.length() == length + need) and
+      (text.compare(0, length, newText) == 0) and
+      (text.find_first_not_of(' ', length) == std::string::npos))
+    return false;
+
+  text.assign(newText);
+  text.append(need, ' ');
+  invalidate();
+  return true;
+}
+
+/**
+ * Mark the Line as needing output.
+ *
+ * The Panels showing the Line output it on the next
+ * Panel::update(Door &).
+ */
+void Line::markDirty(void) {
+  if (dirty)
+    return;
+  dirty = true;
+  // A title isn't repainted by itself, it is part of the image.
+  for (const Placement &p : placements) {
+    if (p.index >= 0)
+      p.panel->dirtyLines.push_back(p.index);
+  }
+}
+
 /**
  * Call updater, report if the text was actually changed.
  *
+ * A changed Line is marked dirty.
+ *
  * @return bool
  */
 bool Line::update(void) {
   if (updater) {
-    std::string newText = updater();
-    // int line_len;
-    int need;
+    if (changeText(updater())) {
+      markDirty();
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Render the text with the render rule or function.
+ *
+ * A render rule renders into the active FrameArena, so the Render must
+ * not outlive the FrameScope.
+ *
+ * @return Render (without outputs if there's no render rule or function)
+ */
+Render Line::renderText(void) const {
+  if (rule)
+    return rule->render(text.data(), text.length(), FrameArena::active());
+  if (render)
+    return render(text);
+  return Render(std::string());
+}
+
+/**
+ * Output Line, without the encoded cache.
+ *
+ * This looks for padding and paddingColor.
+ * This uses the render rule or function if set.
+ *
+ * @param os std::ostream
+ * @param r Render from renderText()
+ */
+void Line::encode(std::ostream &os, const Render &r) const {
+  if (!padding.empty()) {
+    os << paddingColor << padding;
+  }
+  if (rule or render) {
+    // This has a renderer.  Use it.
+    r.output(os);
+  } else {
+    if (hasColor) {
+      os << color;
+    };
+    os << text;
+  }
+  if (!padding.empty()) {
+    os << paddingColor << padding;
+  }
+}
+
+/**
+ * Append columns of the given text, in one color.
+ *
+ * @param out columns
+ * @param cp start of text
+ * @param end end of text
+ * @param color color of the text
+ */
+void Line::appendCells(std::vector<Cell> &out, const char *cp,
+                       const char *end, const ANSIColor &color) {
+  while (cp < end) {
+    Cell cell;
+    int len = 1;
     if (unicode) {
-      // line_len = utf8::distance(text.begin(), text.end());
-      need = width - utf8::distance(newText.begin(), newText.end());
-    } else {
-      // line_len = text.length();
-      need = width - newText.length();
+      unsigned char c = *cp;
+      if ((c & 0xe0) == 0xc0)
+        len = 2;
+      else if ((c & 0xf0) == 0xe0)
+        len = 3;
+      else if ((c & 0xf8) == 0xf0)
+        len = 4;
+      if (len > end - cp)
+        len = end - cp;
     }
+    memcpy(cell.ch, cp, len);
+    cell.len = len;
+    cell.color = color;
+    out.push_back(cell);
+    cp += len;
+  }
+}
+
+/**
+ * Build the columns the Line outputs.
+ *
+ * This matches encode(), column by column.
+ *
+ * @param out columns
+ * @param start Door color before the Line
+ * @param r Render from renderText()
+ */
+void Line::makeCells(std::vector<Cell> &out, const ANSIColor &start,
+                     const Render &r) const {
+  out.clear();
+  ANSIColor current = start;
 
-    need -= padding.length() * 2;
-    if (need > 0) {
-      newText.append(std::string(need, ' '));
+  if (!padding.empty()) {
+    current = paddingColor;
+    appendCells(out, padding.data(), padding.data() + padding.length(),
+                current);
+  }
+
+  if (rule or render) {
+    const char *data = text.data();
+    int length = text.length();
+
+    for (const ColorOutput &co : r.outputs) {
+      if (co.pos >= length)
+        break;
+      current = co.color();
+      appendCells(out, data + co.pos,
+                  data + co.pos + std::min(co.len, length - co.pos), current);
     }
-    if (newText != text) {
-      text = newText;
-      return true;
+  } else {
+    if (hasColor)
+      current = color;
+    appendCells(out, text.data(), text.data() + text.length(), current);
+  }
+
+  if (!padding.empty())
+    appendCells(out, padding.data(), padding.data() + padding.length(),
+                paddingColor);
+}
+
+/**
+ * Find the columns that changed.
+ *
+ * @param now columns
+ * @param was columns output before (the same size as now)
+ * @param[out] first,last changed columns (inclusive)
+ * @return bool false if nothing changed
+ */
+static bool changedColumns(const std::vector<Line::Cell> &now,
+                           const std::vector<Line::Cell> &was, int &first,
+                           int &last) {
+  auto same = [](const Line::Cell &a, const Line::Cell &b) -> bool {
+    return (a.len == b.len) and (memcmp(a.ch, b.ch, a.len) == 0) and
+           (a.color == b.color);
+  };
+
+  first = 0;
+  last = now.size() - 1;
+  while ((first <= last) and same(now[first], was[first]))
+    ++first;
+  if (first > last)
+    return false;
+  while (same(now[last], was[last]))
+    --last;
+  return true;
+}
+
+/**
+ * Output only the columns that changed since the Line was last output.
+ *
+ * The Line must have been output at x, y.  If it hasn't been output
+ * yet, or the number of columns changed, the whole Line is output.
+ *
+ * @param d Door
+ * @param x column of the Line
+ * @param y row of the Line
+ */
+void Line::outputChanges(Door &d, int x, int y) {
+  FrameScope frame;
+  Positions where{frameAllocator<Positions::value_type>()};
+  where.push_back(std::make_pair(x, y));
+  outputChanges(d, where);
+}
+
+/**
+ * Output the changed columns at each position the Line is shown.
+ *
+ * The Line is rendered once, and the same output is sent to each
+ * position.
+ *
+ * @param d Door
+ * @param where column and row of each copy of the Line
+ */
+void Line::outputChanges(Door &d, const Positions &where) {
+  std::vector<Cell> &now = nextCells;
+  if (!cells.empty())
+    makeCells(now, cellsFrom, renderText());
+
+  if (cells.empty() or (now.size() != cells.size())) {
+    ANSIColor start = d.previous;
+    for (size_t i = 0; i < where.size(); ++i) {
+      d << Goto(where[i].first, where[i].second);
+      // Start from the same color, so the encoded output is reused.
+      if (i > 0)
+        d << start;
+      d << *this;
     }
+    return;
+  }
+
+  int first, last;
+  if (!changedColumns(now, cells, first, last))
+    return;
+
+  for (const auto &xy : where) {
+    d << Goto(xy.first + first, xy.second);
+    for (int c = first; c <= last; ++c) {
+      d << now[c].color;
+      d.write(now[c].ch, now[c].len);
+    }
+  }
+  cells.swap(now);
+}
+
+/**
+ * Output the changes in every (visible) Panel showing the Line.
+ *
+ * @param d Door
+ */
+void Line::repaint(Door &d) {
+  Positions where{frameAllocator<Positions::value_type>()};
+  dirty = false;
+
+  for (const Placement &p : placements) {
+    if (p.panel->hidden or p.panel->occluded)
+      continue;
+    int col, row;
+    p.panel->linePosition(p.index, col, row);
+    where.push_back(std::make_pair(col, row));
+  }
+  if (!where.empty())
+    outputChanges(d, where);
+
+  // Panels partly covered on their Screen only show what is visible.
+  for (const Placement &p : placements) {
+    if (!p.panel->hidden and p.panel->occluded)
+      p.panel->screen->paintLine(d, *p.panel, p.index);
+  }
+}
+
+/**
+ * Report the changed columns, in every (visible) Panel showing the Line.
+ *
+ * The columns are added to columns, and output later by the Screen.
+ *
+ * @param out damage
+ * @param columns damaged columns
+ */
+void Line::damage(Damages &out, std::vector<Cell> &columns) {
+  dirty = false;
+  std::vector<Cell> &now = nextCells;
+  makeCells(now, cellsFrom, renderText());
+
+  int first = 0;
+  int last = now.size() - 1;
+  if (now.size() == cells.size()) {
+    if (!changedColumns(now, cells, first, last))
+      return;
+  } else if (now.empty())
+    return;
+
+  std::size_t at = columns.size();
+  columns.insert(columns.end(), now.begin() + first, now.begin() + last + 1);
+  for (const Placement &p : placements) {
+    if (p.panel->hidden)
+      continue;
+    int col, row;
+    p.panel->linePosition(p.index, col, row);
+    Damage damage;
+    damage.row = row;
+    damage.first = col + first;
+    damage.last = col + last;
+    damage.panel = p.panel;
+    damage.cell = at;
+    out.push_back(damage);
+  }
+  cells.swap(now);
+}
+
+/**
+ * Forget the encoded output.
+ *
+ * Called whenever something that changes the output is set.
+ */
+void Line::invalidate(void) {
+  encodedValid = false;
+  encoded.clear();
+  otherValid = false;
+  for (auto &p : placements)
+    p.panel->joinsValid = false;
+  // Lines with updaters are output again each time, they aren't part of
+  // the Panel image.
+  if (!updater) {
+    for (auto &p : placements)
+      p.panel->imageValid = false;
   }
-  return false;
 }
 
 /**
  * Output Line
  *
- * This looks for padding and paddingColor.
- * This uses the render function if set.
+ * The encoded output (colors, padding and text) is remembered.  It is
+ * reused while the Line is unchanged, the Door color before it is the
+ * same and door::unicode hasn't changed.
  *
  * @param os std::ostream
  * @param l const Line &
  * @return std::ostream&
  */
 std::ostream &operator<<(std::ostream &os, const Line &l) {
-  // Door *d = dynamic_cast<Door *>(&os);
-
-  if (!l.padding.empty()) {
-    os << l.paddingColor << l.padding;
+  FrameScope frame;
+  Door *d = dynamic_cast<Door *>(&os);
+  if (d == nullptr) {
+    l.encode(os, l.renderText());
+    return os;
   }
-  if (l.render) {
-    // This has a renderer.  Use it.
-    Render r = l.render(l.text);
-    r.output(os);
-  } else {
-    if (l.hasColor) {
-      os << l.color;
-    };
-    os << l.text;
+  if (d->capturing() != nullptr) {
+    // Captured by a Panel image, which is sent in place of this output.
+    Render r = l.renderText();
+    l.makeCells(l.cells, d->previous, r);
+    l.cellsFrom = d->previous;
+    l.encode(os, r);
+    return os;
   }
-  if (!l.padding.empty()) {
-    os << l.paddingColor << l.padding;
+
+  if (!l.encodedValid or (l.encodedUnicode != unicode) or
+      (l.encodedFrom != d->previous)) {
+    int x = d->cx;
+    Render r = l.renderText();
+    l.makeCells(l.cells, d->previous, r);
+    l.cellsFrom = d->previous;
+    l.encoded.clear();
+    l.encodedFrom = d->previous;
+    l.encodedUnicode = unicode;
+
+    {
+      CaptureScope capture(*d, l.encoded);
+      l.encode(os, r);
+    }
+
+    l.encodedTo = d->previous;
+    l.encodedWidth = d->cx - x;
+    l.encodedValid = true;
+    d->cx = x;
   }
 
+  d->track = false;
+  d->write(l.encoded.data(), l.encoded.length());
+  d->track = true;
+  d->cx += l.encodedWidth;
+  d->previous = l.encodedTo;
   return os;
 }
 
@@ -0,0 +1,218 @@
+#include "door.h"
+#include <unordered_map>
+
+/**
+ * @file
+ * @brief BBS color markup
+ */
+
+namespace door {
+
+/**
+ * @brief DOS color order to ANSI COLOR.
+ *
+ * DOS: black, blue, green, cyan, red, magenta, brown, gray.
+ */
+static const COLOR DOS_COLORS[8] = {COLOR::BLACK, COLOR::BLUE,    COLOR::GREEN,
+                                    COLOR::CYAN,  COLOR::RED,     COLOR::MAGENTA,
+                                    COLOR::BROWN, COLOR::WHITE};
+
+/**
+ * @brief WWIV heart code colors, as DOS attribute bytes.
+ */
+static const unsigned char WWIV_COLORS[10] = {0x07, 0x0b, 0x0e, 0x05, 0x1f,
+                                              0x02, 0x8c, 0x09, 0x01, 0x03};
+
+/**
+ * Convert a DOS attribute byte (background << 4 | foreground) into a
+ * PackedColor.
+ *
+ * @param attr DOS attribute
+ * @return PackedColor
+ */
+static PackedColor dosAttribute(unsigned char attr) {
+  return PackedColor(DOS_COLORS[attr & 0x07], DOS_COLORS[(attr >> 4) & 0x07],
+                     (attr & 0x08) != 0, (attr & 0x80) != 0);
+}
+
+/**
+ * Value of a hex digit, or -1.
+ */
+static int hexValue(char c) {
+  if ((c >= '0') and (c <= '9'))
+    return c - '0';
+  if ((c >= 'A') and (c <= 'F'))
+    return c - 'A' + 10;
+  if ((c >= 'a') and (c <= 'f'))
+    return c - 'a' + 10;
+  return -1;
+}
+
+/**
+ * Compile BBS color markup into text and color runs.
+ *
+ * Codes that aren't understood are left in the text.
+ *
+ * @param markup text with color codes
+ * @return Render
+ */
+Render compileMarkup(const std::string &markup) {
+  std::string text;
+  text.reserve(markup.length());
+
+  // Runs are recorded first, so the Render is built once the text is known.
+  Render::ColorOutputs runs;
+  PackedColor current(COLOR::WHITE, COLOR::BLACK);
+
+  auto setColor = [&](PackedColor c) {
+    // drop a color that was never used
+    if (!runs.empty() and (runs.back().len == 0))
+      runs.pop_back();
+    if (runs.empty() or (runs.back().c != c)) {
+      ColorOutput co;
+      co.c = c;
+      co.pos = text.length();
+      co.len = 0;
+      runs.push_back(co);
+    }
+    current = c;
+  };
+
+  setColor(current);
+
+  const char *cp = markup.c_str();
+  const char *end = cp + markup.length();
+
+  while (cp < end) {
+    if ((*cp == '|') and (end - cp >= 3)) {
+      if (isdigit((unsigned char)cp[1]) and isdigit((unsigned char)cp[2])) {
+        int code = (cp[1] - '0') * 10 + (cp[2] - '0');
+        if (code < 16) {
+          PackedColor c(DOS_COLORS[code & 0x07], current.bg(), code >= 8,
+                        current.blink());
+          setColor(c);
+          cp += 3;
+          continue;
+        }
+        if (code < 24) {
+          PackedColor c(current.fg(), DOS_COLORS[code - 16], current.bright(),
+                        current.blink());
+          setColor(c);
+          cp += 3;
+          continue;
+        }
+      }
+      if ((cp[1] == 'B') and (cp[2] >= '0') and (cp[2] <= '7')) {
+        PackedColor c(current.fg(), DOS_COLORS[cp[2] - '0'], current.bright(),
+                      current.blink());
+        setColor(c);
+        cp += 3;
+        continue;
+      }
+    }
+
+    if ((*cp == '@') and (end - cp >= 4) and (cp[1] == 'X')) {
+      int bg = hexValue(cp[2]);
+      int fg = hexValue(cp[3]);
+      if ((bg >= 0) and (fg >= 0)) {
+        setColor(dosAttribute((bg << 4) | fg));
+        cp += 4;
+        continue;
+      }
+    }
+
+    if ((*cp == '\x03') and (end - cp >= 2) and
+        isdigit((unsigned char)cp[1])) {
+      setColor(dosAttribute(WWIV_COLORS[cp[1] - '0']));
+      cp += 2;
+      continue;
+    }
+
+    text.append(1, *cp);
+    ++runs.back().len;
+    ++cp;
+  }
+
+  if (!runs.empty() and (runs.back().len == 0))
+    runs.pop_back();
+
+  Render r(text);
+  r.outputs = std::move(runs);
+  return r;
+}
+
+/**
+ * @brief Compiled markup, by markup text.
+ */
+static std::unordered_map<std::string, std::shared_ptr<const Render>>
+    markup_cache;
+
+/// Most markup kept in markup_cache
+static const std::size_t MARKUP_CACHE_LIMIT = 256;
+
+/**
+ * Compile markup, or return the already compiled markup.
+ *
+ * The cache is meant for static text (prompts, menus).  So that markup
+ * with changing values (scores, names) can't grow it without bound, it
+ * is emptied when it holds MARKUP_CACHE_LIMIT entries.  Lines already
+ * using compiled markup keep their copy.
+ *
+ * @param markup text with color codes
+ * @return std::shared_ptr<const Render>
+ */
+std::shared_ptr<const Render> cachedMarkup(const std::string &markup) {
+  auto it = markup_cache.find(markup);
+  if (it != markup_cache.end())
+    return it->second;
+
+  std::shared_ptr<const Render> compiled =
+      std::make_shared<const Render>(compileMarkup(markup));
+  if (markup_cache.size() >= MARKUP_CACHE_LIMIT)
+    markup_cache.clear();
+  markup_cache[markup] = compiled;
+  return compiled;
+}
+
+/**
+ * Forget all compiled markup.
+ *
+ * Lines already using compiled markup keep their copy.
+ */
+void clearMarkupCache(void) { markup_cache.clear(); }
+
+/**
+ * Make a renderFunction that uses compiled markup.
+ *
+ * If the text is longer (padding from Line::fit), the last color
+ * is used for the rest of the text.
+ *
+ * @param compiled Render from compileMarkup / cachedMarkup
+ * @return renderFunction
+ */
+renderFunction markupRender(std::shared_ptr<const Render> compiled) {
+  renderFunction render = [compiled](const std::string &txt) -> Render {
+    Render r(txt);
+    int length = txt.length();
+
+    for (const ColorOutput &co : compiled->outputs) {
+      if (co.pos >= length)
+        break;
+      int len = std::min(co.len, length - co.pos);
+      if (co.extended())
+        r.append(co.color(), len);
+      else
+        r.append(co.c, len);
+    }
+
+    if (!r.outputs.empty()) {
+      ColorOutput &last = r.outputs.back();
+      if (last.pos + last.len < length)
+        last.len = length - last.pos;
+    }
+    return r;
+  };
+  return render;
+}
+
+} // namespace door
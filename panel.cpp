@@ -1,5 +1,6 @@
 #include "door.h"
-#include <set>
+#include <algorithm>
+#include <cassert>
 #include <string.h>
 
 /**
@@ -25,6 +26,8 @@ Panel::Panel(int xp, int yp, int panelWidth) : border_color() {
   y = yp;
   width = panelWidth;
   hidden = false;
+  shown_once = false;
+  offset = 0;
   border_style = BorderStyle::NONE;
   // border_color = ANSIColor();
 }
@@ -34,18 +37,71 @@ Panel::Panel(int panelWidth) : border_color() {
   y = 0;
   width = panelWidth;
   hidden = false;
+  shown_once = false;
+  offset = 0;
   border_style = BorderStyle::NONE;
 }
 
-Panel::Panel(Panel &&ref) {
-  x = ref.x;
-  y = ref.y;
-  width = ref.width;
-  hidden = ref.hidden;
-  border_style = ref.border_style;
-  title = std::move(ref.title);
-  offset = ref.offset;
-  lines = std::move(ref.lines);
+/**
+ * @brief Move a Panel
+ *
+ * The lines are moved, and their placements now point to this Panel.
+ *
+ * @param ref Panel&&
+ */
+Panel::Panel(Panel &&ref) noexcept
+    : x{ref.x}, y{ref.y}, width{ref.width}, border_style{ref.border_style},
+      border_color{ref.border_color}, lines{std::move(ref.lines)},
+      hidden{ref.hidden}, shown_once{ref.shown_once},
+      title{std::move(ref.title)}, offset{ref.offset},
+      dirtyLines{std::move(ref.dirtyLines)}, polled{std::move(ref.polled)},
+      polledValid{ref.polledValid}, joins{std::move(ref.joins)},
+      joinsValid{ref.joinsValid}, joinsUnicode{ref.joinsUnicode} {
+  ref.polledValid = false;
+  ref.joinsValid = false;
+  if (title) {
+    for (auto &p : title->placements)
+      p.panel = this;
+  }
+  for (auto &line : lines) {
+    for (auto &p : line->placements) {
+      if (p.panel == &ref)
+        p.panel = this;
+    }
+  }
+}
+
+/**
+ * @brief Destroy the Panel
+ *
+ * The lines may be shown in other panels, so remove this Panel from them.
+ */
+Panel::~Panel() {
+  for (auto &line : lines) {
+    auto &placements = line->placements;
+    for (size_t i = 0; i < placements.size();) {
+      if (placements[i].panel == this)
+        placements.erase(placements.begin() + i);
+      else
+        ++i;
+    }
+  }
+}
+
+/**
+ * @brief Screen position of a line.
+ *
+ * @param index line index
+ * @param col column
+ * @param row row
+ */
+void Panel::linePosition(int index, int &col, int &row) const {
+  col = x;
+  row = y + index;
+  if (border_style != BorderStyle::NONE) {
+    ++col;
+    ++row;
+  }
 }
 
 /*
@@ -79,23 +135,88 @@ Panel::Panel(const Panel &original) : border_color(original.border_color) {
 void Panel::set(int xp, int yp) {
   x = xp;
   y = yp;
+  imageValid = false;
+  restacked();
 }
 
+/**
+ * @brief Set the title, shown in the top border
+ *
+ * The title is placed in this Panel, so changing its text rebuilds the
+ * image.
+ *
+ * @param t title Line
+ * @param off column offset in the top border
+ */
 void Panel::setTitle(std::unique_ptr<Line> t, int off) {
   title = std::move(t);
+  if (title) {
+    Line::Placement placement;
+    placement.panel = this;
+    placement.index = -1;
+    title->placements.push_back(placement);
+  }
   offset = off;
+  imageValid = false;
 }
 
-void Panel::setStyle(BorderStyle bs) { border_style = bs; }
+void Panel::setStyle(BorderStyle bs) {
+  border_style = bs;
+  imageValid = false;
+  restacked();
+}
 // Panel::Panel(Panel &old) = { }
-void Panel::setColor(ANSIColor c) { border_color = c; }
+void Panel::setColor(ANSIColor c) {
+  border_color = c;
+  imageValid = false;
+}
 
-void Panel::hide(void) { hidden = true; }
-void Panel::show(void) { hidden = false; }
-void Panel::addLine(std::unique_ptr<Line> l) {
+void Panel::hide(void) {
+  hidden = true;
+  restacked();
+}
+void Panel::show(void) {
+  hidden = false;
+  restacked();
+}
+
+/**
+ * @brief The Panel's area or visibility changed, its Screen has to find
+ * the occluded panels again.
+ */
+void Panel::restacked(void) {
+  if (screen)
+    screen->stackValid = false;
+}
+static signed char joinType(const char *text);
+
+void Panel::addLine(std::shared_ptr<Line> l) {
   l->fit();
+  joinsValid = false;
+  Line::Placement placement;
+  placement.panel = this;
+  placement.index = lines.size();
+  l->placements.push_back(placement);
+  polledValid = false;
+  imageValid = false;
+  restacked();
   lines.push_back(std::move(l));
 }
+
+/**
+ * @brief Find the lines that have updaters.
+ *
+ * Only these are polled by update(), other lines are output when
+ * they are marked dirty.
+ */
+void Panel::findPolled(void) {
+  polled.clear();
+  for (size_t i = 0; i < lines.size(); ++i) {
+    if (lines[i]->updater)
+      polled.push_back(i);
+  }
+  polledValid = true;
+}
 // or possibly std::move(l)); }
 
 /*
@@ -260,6 +381,109 @@ const char *UJOIN[2][2][2] = {{
                                   {"\u2560", "\u2563"}, // DD ╠ ╣
                               }};
 
+/**
+ * @brief Box characters for a border style.
+ *
+ * @param style (int)BorderStyle, greater than 0
+ * @return box_styles
+ */
+static box_styles borderStyle(int style) {
+  box_styles s;
+  if (style < 5) {
+    if (unicode)
+      s = UBOXES[style - 1];
+    else
+      s = BOXES[style - 1];
+  } else {
+    s.bl = s.br = s.mr = s.ml = " ";
+    s.top = s.side = " ";
+    s.tl = s.tr = " ";
+  }
+  return s;
+}
+
+/**
+ * @brief Is the text a spacer line, that joins the border?
+ *
+ * @param text line text
+ * @return signed char 0 single line, 1 double line, -1 not a spacer.
+ */
+static signed char joinType(const char *text) {
+  signed char line_is = -1;
+  if (door::unicode) {
+    if (strncmp(UBOXES[0].top, text, strlen(UBOXES[0].top)) == 0)
+      line_is = 0;
+    if (strncmp(UBOXES[1].top, text, strlen(UBOXES[1].top)) == 0)
+      line_is = 1;
+  } else {
+    if (BOXES[0].top[0] == text[0])
+      line_is = 0;
+    if (BOXES[1].top[0] == text[0])
+      line_is = 1;
+  }
+  return line_is;
+}
+
+/**
+ * @brief Find the join type of each line
+ *
+ * The joins depend on the line text and door::unicode, they are found
+ * again when a Line is invalidated or door::unicode changes.
+ */
+void Panel::findJoins(void) const {
+  if (joinsValid and (joinsUnicode == unicode) and
+      (joins.size() == lines.size()))
+    return;
+  joins.clear();
+  joins.reserve(lines.size());
+  for (auto &line : lines)
+    joins.push_back(joinType(line->getText()));
+  joinsUnicode = unicode;
+  joinsValid = true;
+}
+
+/**
+ * @brief Which JOIN characters go with the border style?
+ *
+ * @param bs BorderStyle
+ * @return int 0 single sides, 1 double sides.
+ */
+static int joinBorder(BorderStyle bs) {
+  switch (bs) {
+  case door::BorderStyle::DOUBLE:
+  case door::BorderStyle::SINGLE_DOUBLE:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Build the border strings, if the width, style or encoding changed.
+ */
+void Panel::borderStrips(void) const {
+  if ((stripWidth == width) and (stripStyle == border_style) and
+      (stripUnicode == unicode))
+    return;
+
+  box_styles s = borderStyle((int)border_style);
+  stripHorizontal.clear();
+  for (int c = 0; c < width; c++)
+    stripHorizontal.append(s.top);
+
+  stripTop = s.tl;
+  stripTop += stripHorizontal;
+  stripTop += s.tr;
+
+  stripBottom = s.bl;
+  stripBottom += stripHorizontal;
+  stripBottom += s.br;
+
+  stripWidth = width;
+  stripStyle = border_style;
+  stripUnicode = unicode;
+}
+
 /*
 void Panel::display(void) {
 
@@ -270,34 +494,55 @@ void Panel::update(void) {
 }
 */
 
+/**
+ * @brief Update the panel.
+ *
+ * Lines with updaters are polled.  Then only the dirty lines
+ * (changed by their updater, or an Observable they watch) are output,
+ * in every Panel that shows them.
+ *
+ * @param d Door
+ * @return true if any lines were repainted (by this update).
+ */
 bool Panel::update(Door &d) {
-  int row = y;
-  int style = (int)border_style;
-  if (style > 0)
-    ++row;
-
-  bool updated = false;
-
-  for (auto &line : lines) {
-    if (line->update()) {
-      /*
-      std::string output = d.previous.debug();
-      d.log(output);
-
-      output = "update():";
-      output.append(line->debug());
-      d.log(output);
-      */
-      updated = true;
-      int col = x;
-      if (style > 0)
-        ++col;
-      d << door::Goto(col, row);
-      d << *line;
+  FrameScope frame;
+  if (!polledValid)
+    findPolled();
+  for (int i : polled)
+    lines[i]->update();
+
+  // A Line shown in other panels is repainted there too, and won't be
+  // dirty when their update gets to it.
+  bool repainted = false;
+  for (int i : dirtyLines) {
+    Line &line = *lines[i];
+    if (line.dirty) {
+      line.repaint(d);
+      repainted = true;
     }
-    ++row;
   }
-  return updated;
+  dirtyLines.clear();
+  return repainted;
+}
+
+/**
+ * @brief Poll the lines, and report the changed columns to the Screen.
+ *
+ * @param out damage
+ * @param columns damaged columns
+ */
+void Panel::damage(Damages &out, std::vector<Line::Cell> &columns) {
+  if (!polledValid)
+    findPolled();
+  for (int i : polled)
+    lines[i]->update();
+
+  for (int i : dirtyLines) {
+    Line &line = *lines[i];
+    if (line.dirty)
+      line.damage(out, columns);
+  }
+  dirtyLines.clear();
 }
 
 void Panel::update(Door &d, int line) {
@@ -317,10 +562,21 @@ void Panel::update(Door &d, int line) {
   d << *l;
 }
 
+/**
+ * @brief Poll the lines, without any output.
+ *
+ * Use this before the panel is output again.  The changed lines are
+ * output with it, so they aren't dirty any more.
+ */
 void Panel::update(void) {
-  for (auto &line : lines) {
-    line->update();
-  }
+  if (!polledValid)
+    findPolled();
+  for (int i : polled)
+    lines[i]->update();
+
+  for (int i : dirtyLines)
+    lines[i]->dirty = false;
+  dirtyLines.clear();
 }
 
 door::Goto Panel::gotoEnd(void) {
@@ -328,7 +584,7 @@ door::Goto Panel::gotoEnd(void) {
   int style = (int)border_style;
   if (style > 0)
     ++row;
-  row += lines.size();
+  row += rowCount();
   int col = x;
   if (style > 0)
     col += 2;
@@ -391,9 +647,184 @@ std::ostream &operator<<(std::ostream &os, const Panel &p) {
   if (p.hidden)
     return os;
 
+  FrameScope frame;
+  p.output(os);
+  return os;
+}
+
+/**
+ * @brief Output the panel (borders and lines)
+ *
+ * The output is kept as an image, with the byte offsets of the lines that
+ * have updaters.  While the panel and its lines are unchanged, the image
+ * is written as is, and only those lines are output again.
+ *
+ * Derived panels with their own storage override this.
+ * @param os
+ */
+void Panel::output(std::ostream &os) const {
+  Door *d = dynamic_cast<Door *>(&os);
+  if ((d == nullptr) or (d->capturing() != nullptr)) {
+    draw(os);
+    return;
+  }
+
+  if (!imageValid or (imageUnicode != unicode) or
+      (imageFrom != d->previous)) {
+    image.clear();
+    imageSpans.clear();
+    imageFrom = d->previous;
+    imageUnicode = unicode;
+
+    {
+      CaptureScope capture(*d, image);
+      draw(os);
+    }
+
+    imageTo = d->previous;
+    imageX = d->cx;
+    imageY = d->cy;
+    imageValid = true;
+  }
+
+  std::size_t pos = 0;
+  for (const ImageSpan &span : imageSpans) {
+    d->write(image.data() + pos, span.start - pos);
+    d->previous = span.from;
+    d->cx = span.cx;
+    d->cy = span.cy;
+    os << *lines[span.index];
+    // The image after the line expects its color.
+    if (d->previous != span.to)
+      os << span.to;
+    pos = span.end;
+  }
+  d->write(image.data() + pos, image.length() - pos);
+  d->previous = imageTo;
+  d->cx = imageX;
+  d->cy = imageY;
+}
+
+/**
+ * @brief Output the top border, with the title.
+ *
+ * @param os
+ */
+void Panel::outputTop(std::ostream &os) const {
+  box_styles s = borderStyle((int)border_style);
+  borderStrips();
+  os << door::Goto(x, y);
+  os << border_color;
+
+  if (title) {
+    int glyph = strlen(s.top);
+    int before = std::max(0, std::min(offset, width));
+    os << s.tl;
+    os.write(stripHorizontal.data(), before * glyph);
+    os << *(title);
+    os << border_color;
+    int left = width - (offset + (title)->length());
+    if (left > 0)
+      os.write(stripHorizontal.data(), left * glyph);
+    os << s.tr;
+  } else {
+    os.write(stripTop.data(), stripTop.length());
+  };
+}
+
+/**
+ * @brief Go to the start of a row, for the panel's own row output.
+ *
+ * @param os
+ * @param row
+ * @param border output the left side of the border too
+ */
+void Panel::beginRow(std::ostream &os, int row, bool border) const {
+  int col, line;
+  linePosition(row, col, line);
+  if (border and (border_style != BorderStyle::NONE))
+    os << door::Goto(x, line) << border_color
+       << borderStyle((int)border_style).side;
+  else
+    os << door::Goto(col, line);
+}
+
+/**
+ * @brief Finish a row started with beginRow().
+ *
+ * @param os
+ * @param border output the right side of the border too
+ */
+void Panel::endRow(std::ostream &os, bool border) const {
+  if (border and (border_style != BorderStyle::NONE))
+    os << border_color << borderStyle((int)border_style).side;
+}
+
+/**
+ * @brief Output columns, with a color only where it changes.
+ *
+ * @param os
+ * @param cells
+ */
+void Panel::outputCells(std::ostream &os,
+                        const std::vector<Line::Cell> &cells) {
+  for (std::size_t i = 0; i < cells.size(); ++i) {
+    if ((i == 0) or (cells[i].color != cells[i - 1].color))
+      os << cells[i].color;
+    os.write(cells[i].ch, cells[i].len);
+  }
+}
+
+/**
+ * @brief Scroll the rows with the terminal.
+ *
+ * Only when the terminal can (scroll_region), the panel is the full
+ * screen width (as the whole rows are scrolled), and it is visible and
+ * not covered by another panel.  The rows scrolled in are blank, and
+ * need to be output (with the border).
+ *
+ * @param d Door
+ * @param count number of rows
+ * @param lines number of rows to scroll up (or down, when negative)
+ * @return true if scrolled
+ */
+bool Panel::scrollRows(Door &d, int count, int lines) {
+  if (!scroll_region or hidden or occluded or (lines == 0) or
+      (std::abs(lines) >= count))
+    return false;
+  int left, upper, right, bottom;
+  frame(left, upper, right, bottom);
+  if ((left != 1) or (d.width <= 0) or (right < d.width))
+    return false;
+
+  int col, first;
+  linePosition(0, col, first);
+  d << CSI << first << ';' << first + count - 1 << 'r';
+  d << door::Goto(1, first) << CSI;
+  if (lines > 0) {
+    // Delete lines at the top, blank lines appear at the bottom.
+    d << lines << 'M';
+  } else {
+    // Insert lines at the top.
+    d << -lines << 'L';
+  }
+  d << CSI << 'r';
+  return true;
+}
+
+/**
+ * @brief Draw the panel (borders and lines)
+ *
+ * When drawing into the image, the lines with updaters are recorded.
+ * @param os
+ */
+void Panel::draw(std::ostream &os) const {
+  Door *d = dynamic_cast<Door *>(&os);
+  bool recording = (d != nullptr) and (d->capturing() == &image);
+
   // Handle borders
-  int style = (int)p.border_style;
-  struct box_styles s;
+  int style = (int)border_style;
+  struct box_styles s{};
 
   // If there's no style, then everything works.
   // If I try style, it prints out first line
@@ -401,16 +832,7 @@ std::ostream &operator<<(std::ostream &os, const Panel &p) {
 
   if (style > 0) {
     // Ok, there needs to be something in this style;
-    if (style < 5) {
-      if (unicode)
-        s = UBOXES[style - 1];
-      else
-        s = BOXES[style - 1];
-    } else {
-      s.bl = s.br = s.mr = s.ml = " ";
-      s.top = s.side = " ";
-      s.tl = s.tr = " ";
-    }
+    s = borderStyle(style);
   }
 
   /*
@@ -419,108 +841,67 @@ std::ostream &operator<<(std::ostream &os, const Panel &p) {
   */
   /*
     os << "style " << style << "."
-       << " width " << p.width;
-    os << " SIZE " << p.lines.size() << " ! " << nl;
+       << " width " << width;
+    os << " SIZE " << lines.size() << " ! " << nl;
   */
 
   // os << s.tl << s.top << s.tr << s.side << s.br << s.bl;
 
-  int row = p.y;
+  int row = y;
 
   if (style > 0) {
     // Top line of border (if needed)
-    os << door::Goto(p.x, row);
-    os << p.border_color << s.tl;
-
-    if (p.title) {
-      for (int c = 0; c < p.offset; c++)
-        os << s.top;
-      os << *(p.title);
-      os << p.border_color;
-      int left = p.width - (p.offset + (p.title)->length());
-      if (left > 0) {
-        for (int c = 0; c < left; c++)
-          os << s.top;
-      };
-      os << s.tr;
-    } else {
-      for (int c = 0; c < p.width; c++)
-        os << s.top;
-      os << s.tr;
-    };
-    // os << "";
-
+    outputTop(os);
     ++row;
   };
 
-  for (auto &line : p.lines) {
-    os << door::Goto(p.x, row);
+  findJoins();
+  for (size_t index = 0; index < lines.size(); ++index) {
+    auto &line = lines[index];
+    os << door::Goto(x, row);
 
-    bool join = false;
-    int line_is = -1;
+    // is this a weird line?  (found by findJoins)
+    int line_is = joins[index];
+    bool join = (line_is >= 0);
     int border_is = -1;
 
-    // is this a weird line?
-    {
-      const char *line_text = line->getText();
-      if (door::unicode) {
-        if (strncmp(UBOXES[0].top, line_text, strlen(UBOXES[0].top)) == 0) {
-          join = true;
-          line_is = 0;
-        }
-        if (strncmp(UBOXES[1].top, line_text, strlen(UBOXES[1].top)) == 0) {
-          join = true;
-          line_is = 1;
-        }
-      } else {
-        if (BOXES[0].top[0] == line_text[0]) {
-          join = true;
-          line_is = 0;
-        }
-        if (BOXES[1].top[0] == line_text[0]) {
-          join = true;
-          line_is = 1;
-        }
-      }
-    }
     if (style > 0) {
       if (join) {
-        switch (p.border_style) {
-        case door::BorderStyle::SINGLE:
-        case door::BorderStyle::DOUBLE_SINGLE:
-          border_is = 0;
-          break;
-
-        case door::BorderStyle::DOUBLE:
-        case door::BorderStyle::SINGLE_DOUBLE:
-          border_is = 1;
-          break;
-        default:
-          break;
-        }
-
-        os << p.border_color;
+        border_is = joinBorder(border_style);
+        os << border_color;
         if (door::unicode)
           os << UJOIN[border_is][line_is][0]; // LEFT
         else
           os << JOIN[border_is][line_is][0]; // LEFT
       } else {
-        os << p.border_color << s.side;
+        os << border_color << s.side;
       };
     };
 
-    // os << "[" << row << "," << p.x << "] ";
-    os << *line;
+    // os << "[" << row << "," << x << "] ";
+    if (recording and line->updater) {
+      ImageSpan span;
+      span.index = index;
+      span.start = image.length();
+      span.from = d->previous;
+      span.cx = d->cx;
+      span.cy = d->cy;
+      os << *line;
+      span.end = image.length();
+      span.to = d->previous;
+      imageSpans.push_back(span);
+    } else
+      os << *line;
 
     if (style > 0) {
       if (join) {
-        os << p.border_color;
+        os << border_color;
         if (door::unicode)
           os << UJOIN[border_is][line_is][1]; // RIGHT
         else
           os << JOIN[border_is][line_is][1]; // RIGHT
       } else
-        os << p.border_color << s.side;
+        os << border_color << s.side;
     };
 
     // os << "row " << row;
@@ -531,17 +912,114 @@ std::ostream &operator<<(std::ostream &os, const Panel &p) {
 
   // Display bottom (if needed)
   if (style > 0) {
-    os << door::Goto(p.x, row);
-    os << p.border_color << s.bl;
-    for (int c = 0; c < p.width; c++)
-      os << s.top;
-    // os << "";
-    os << s.br;
+    os << door::Goto(x, row);
+    os << border_color;
+    os.write(stripBottom.data(), stripBottom.length());
   };
   // };
   // os << flush;
-  return os;
-} // namespace door
+}
+
+/**
+ * @brief The screen area of the panel, including the border.
+ *
+ * @param[out] left,top,right,bottom corners (inclusive)
+ */
+void Panel::frame(int &left, int &top, int &right, int &bottom) const {
+  int border = (border_style == BorderStyle::NONE) ? 0 : 2;
+  left = x;
+  top = y;
+  right = x + width + border - 1;
+  bottom = y + rowCount() + border - 1;
+}
+
+/**
+ * @brief The columns of a row of the panel, including the border.
+ *
+ * This is what Panel::output draws on that row, so a Screen can output
+ * just the visible part of it.
+ *
+ * @param row row of the panel (0 is the top border, if there is one)
+ * @param out columns
+ */
+void Panel::rowCells(int row, std::vector<Line::Cell> &out) const {
+  out.clear();
+  int style = (int)border_style;
+  if (style == 0) {
+    if (row < rowCount())
+      lineCells(row, out);
+    return;
+  }
+
+  box_styles s = borderStyle(style);
+  auto glyph = [&](const char *g) {
+    Line::appendCells(out, g, g + strlen(g), border_color);
+  };
+
+  if (row == 0) {
+    int c = 0;
+    glyph(s.tl);
+    if (title) {
+      for (; (c < offset) and (c < width); ++c)
+        glyph(s.top);
+      std::vector<Line::Cell> heading;
+      title->makeCells(heading, border_color, title->renderText());
+      for (const Line::Cell &cell : heading) {
+        if (c == width)
+          break;
+        out.push_back(cell);
+        ++c;
+      }
+    }
+    for (; c < width; ++c)
+      glyph(s.top);
+    glyph(s.tr);
+  } else if (row > rowCount()) {
+    glyph(s.bl);
+    for (int c = 0; c < width; ++c)
+      glyph(s.top);
+    glyph(s.br);
+  } else {
+    int index = row - 1;
+    const char *left = s.side;
+    const char *right = s.side;
+    findJoins();
+    int line_is = joins[index];
+    if (line_is >= 0) {
+      int border_is = joinBorder(border_style);
+      left = unicode ? UJOIN[border_is][line_is][0]
+                     : JOIN[border_is][line_is][0];
+      right = unicode ? UJOIN[border_is][line_is][1]
+                      : JOIN[border_is][line_is][1];
+    }
+    glyph(left);
+    lineCells(index, out);
+    glyph(right);
+  }
+}
+
+/**
+ * @brief Append the columns of a line, exactly width of them.
+ *
+ * The Line's own columns are left alone, they are what its other
+ * placements show (see Line::outputChanges).
+ *
+ * @param index line index
+ * @param out columns
+ */
+void Panel::lineCells(int index, std::vector<Line::Cell> &out) const {
+  const Line &line = *lines[index];
+  std::vector<Line::Cell> cells;
+  line.makeCells(cells, border_color, line.renderText());
+
+  int count = std::min((int)cells.size(), width);
+  out.insert(out.end(), cells.begin(), cells.begin() + count);
+  Line::Cell blank;
+  blank.ch[0] = ' ';
+  blank.len = 1;
+  for (; count < width; ++count)
+    out.push_back(blank);
+}
 
 /*
 std::function<void(Door &d, std::string &)> Menu::defaultSelectedColorizer =
@@ -565,6 +1043,121 @@ renderFunction Menu::defaultUnselectedRender =
                      ANSIColor(COLOR::WHITE, COLOR::BLUE, ATTR::BOLD),
                      ANSIColor(COLOR::WHITE, COLOR::BLUE, ATTR::BOLD),
                      ANSIColor(COLOR::YELLOW, COLOR::BLUE, ATTR::BOLD));
+std::shared_ptr<const RenderRule> Menu::defaultSelectedRule =
+    std::make_shared<const RenderRule>(Menu::makeRule(
+        ANSIColor(COLOR::BLUE, COLOR::WHITE),
+        ANSIColor(COLOR::BLUE, COLOR::WHITE),
+        ANSIColor(COLOR::BLUE, COLOR::WHITE),
+        ANSIColor(COLOR::BLUE, COLOR::WHITE)));
+std::shared_ptr<const RenderRule> Menu::defaultUnselectedRule =
+    std::make_shared<const RenderRule>(
+        Menu::makeRule(ANSIColor(COLOR::WHITE, COLOR::BLUE, ATTR::BOLD),
+                       ANSIColor(COLOR::WHITE, COLOR::BLUE, ATTR::BOLD),
+                       ANSIColor(COLOR::WHITE, COLOR::BLUE, ATTR::BOLD),
+                       ANSIColor(COLOR::YELLOW, COLOR::BLUE, ATTR::BOLD)));
+
+/**
+ * @brief Add an item.
+ *
+ * @param text item text
+ * @param item item
+ */
+void PrefixIndex::add(const std::string &text, int item) {
+  std::string key = text;
+  for (char &c : key)
+    c = tolower((unsigned char)c);
+  keys.push_back(std::make_pair(key, item));
+  sorted = false;
+}
+
+void PrefixIndex::clear(void) {
+  keys.clear();
+  sorted = true;
+  reset();
+}
+
+/**
+ * @brief Forget what was typed, everything matches.
+ */
+void PrefixIndex::reset(void) {
+  if (!sorted) {
+    std::sort(keys.begin(), keys.end());
+    sorted = true;
+  }
+  prefix.clear();
+  first = 0;
+  last = keys.size();
+}
+
+/**
+ * @brief Add a typed character to the prefix.
+ *
+ * The matching keys all have the prefix, so they are sorted by the next
+ * character.
+ *
+ * @param c typed character
+ * @return bool false if nothing matches (the prefix isn't changed)
+ */
+bool PrefixIndex::narrow(char c) {
+  if (!sorted)
+    reset();
+  c = tolower((unsigned char)c);
+  std::size_t depth = prefix.length();
+  // Keys that end before depth sort first.
+  auto at = [depth](const std::pair<std::string, int> &key) -> int {
+    if (key.first.length() <= depth)
+      return -1;
+    return (unsigned char)key.first[depth];
+  };
+  int want = (unsigned char)c;
+
+  auto begin = keys.begin() + first;
+  auto end = keys.begin() + last;
+  auto low = std::lower_bound(
+      begin, end, want,
+      [&at](const std::pair<std::string, int> &key, int value) -> bool {
+        return at(key) < value;
+      });
+  auto high = std::upper_bound(
+      low, end, want,
+      [&at](int value, const std::pair<std::string, int> &key) -> bool {
+        return value < at(key);
+      });
+  if (low == high)
+    return false;
+
+  first = low - keys.begin();
+  last = high - keys.begin();
+  prefix += c;
+  return true;
+}
+
+/**
+ * @brief Remove the last typed character (backspace).
+ *
+ * @return bool false if nothing was typed.
+ */
+bool PrefixIndex::back(void) {
+  if (prefix.empty())
+    return false;
+  std::string typed = prefix;
+  typed.pop_back();
+  reset();
+  for (char c : typed)
+    narrow(c);
+  return true;
+}
+
+/**
+ * @brief The first (sorted) item matching the prefix.
+ *
+ * @return int item, or -1 if nothing matches.
+ */
+int PrefixIndex::match(void) const {
+  if (first == last)
+    return -1;
+  return keys[first].second;
+}
 
 /**
  * @brief Construct a new Menu object
@@ -580,13 +1173,14 @@ Menu::Menu(int x, int y, int width) : Panel(x, y, width) {
   setStyle(BorderStyle::DOUBLE);
   // Setup initial sensible default values.
   // setColorizer(true, defaultSelectedColorizer);
-  setRender(true, defaultSelectedRender);
+  selectedRule = defaultSelectedRule;
   /* makeColorizer(Color(Colors::BLUE, Colors::WHITE, 0),
                                    Color(Colors::BLUE, Colors::WHITE, 0),
                                    Color(Colors::BLUE, Colors::WHITE, 0),
                                    Color(Colors::BLUE, Colors::WHITE, 0)));
    */
-  setRender(false, defaultUnselectedRender);
+  unselectedRule = defaultUnselectedRule;
+  hotkeys.fill(-1);
   // setColorizer(false, defaultUnselectedColorizer);
   /* makeColorizer(Color(Colors::LWHITE, Colors::BLUE, 0),
                                     Color(Colors::LWHITE, Colors::BLUE),
@@ -605,8 +1199,9 @@ Menu::Menu(int x, int y, int width) : Panel(x, y, width) {
  */
 Menu::Menu(int width) : Panel(width) {
   setStyle(BorderStyle::DOUBLE);
-  setRender(true, defaultSelectedRender);
-  setRender(false, defaultUnselectedRender);
+  selectedRule = defaultSelectedRule;
+  unselectedRule = defaultUnselectedRule;
+  hotkeys.fill(-1);
   chosen = 0;
 }
 
@@ -624,17 +1219,19 @@ Menu::Menu(const Menu &original)
 }
 */
 
-Menu::Menu(Menu &&ref) : Panel(ref.x, ref.y, ref.width) {
-  x = ref.x;
-  y = ref.y;
-  width = ref.width;
-  border_style = ref.border_style;
-  setRender(true, ref.selectedRender);
-  setRender(false, ref.unselectedRender);
-  options = ref.options;
-  lines = std::move(ref.lines);
-  chosen = ref.chosen;
-}
+/**
+ * @brief Move a Menu
+ *
+ * @param ref Menu&&
+ */
+Menu::Menu(Menu &&ref) noexcept
+    : Panel(std::move(ref)), chosen{ref.chosen},
+      options{std::move(ref.options)}, search{std::move(ref.search)},
+      selectedRender{std::move(ref.selectedRender)},
+      unselectedRender{std::move(ref.unselectedRender)},
+      selectedRule{std::move(ref.selectedRule)},
+      unselectedRule{std::move(ref.unselectedRule)}, hotkeys{ref.hotkeys},
+      use_numberpad{ref.use_numberpad}, rendered{ref.rendered} {}
 
 void Menu::addSelection(char c, const char *line) {
   std::string menuline;
@@ -647,7 +1244,7 @@ void Menu::addSelection(char c, const char *line) {
   // L->makeWidth(width);
 
   addLine(std::make_unique<Line>(menuline, width));
-  options.push_back(c);
+  addOption(c, line);
 }
 
 /**
@@ -678,7 +1275,27 @@ void Menu::addSelection(char c, const char *line, updateFunction update) {
   l->setUpdater(fullUpdate);
   // addLine(std::make_unique<Line>(menuline, width));
   addLine(std::move(l));
+  addOption(c, line);
+}
+
+/**
+ * @brief Add the option key, for the line just added.
+ *
+ * The hotkey table is built here, so choose() only looks keys up.
+ *
+ * @param c option key
+ * @param line option text, for type-ahead
+ */
+void Menu::addOption(char c, const char *line) {
+  int index = options.size();
+  search.add(line, index);
   options.push_back(c);
+  hotkeys[(unsigned char)toupper(c)] = index;
+  // Don't use the numberpad, if any of the options are 8 or 2 (up/down)
+  if ((c == '8') or (c == '2'))
+    use_numberpad = false;
+  // The new line needs its render.
+  rendered = -1;
 }
 
 void Menu::defaultSelection(int d) { chosen = d; }
@@ -694,10 +1311,73 @@ unselectedColorizer = colorizer;
 */
 
 void Menu::setRender(bool selected, renderFunction render) {
-  if (selected)
+  if (selected) {
     selectedRender = render;
-  else
+    selectedRule.reset();
+  } else {
     unselectedRender = render;
+    unselectedRule.reset();
+  }
+  rendered = -1;
+}
+
+/**
+ * @brief Set the RenderRule for selected or unselected lines.
+ *
+ * All of the lines share the rule, without a renderFunction.
+ *
+ * @param selected
+ * @param rule
+ */
+void Menu::setRender(bool selected, const RenderRule &rule) {
+  std::shared_ptr<const RenderRule> shared =
+      std::make_shared<const RenderRule>(rule);
+  if (selected) {
+    selectedRule = shared;
+    selectedRender = nullptr;
+  } else {
+    unselectedRule = shared;
+    unselectedRender = nullptr;
+  }
+  rendered = -1;
+}
+
+/**
+ * @brief Give each line the selected or unselected render.
+ *
+ * This is done when the lines or renders change, not for every choose().
+ */
+void Menu::renderLines(void) {
+  for (unsigned int x = 0; x < lines.size(); ++x) {
+    bool selected = (x == chosen);
+    const std::shared_ptr<const RenderRule> &rule =
+        selected ? selectedRule : unselectedRule;
+    if (rule)
+      lines[x]->setRender(rule);
+    else
+      lines[x]->setRender(selected ? selectedRender : unselectedRender);
+  }
+  rendered = chosen;
+}
+
+/**
+ * @brief Move the selected render to a line.
+ *
+ * The line that had it gets the unselected render back.  Swapping keeps
+ * the encoded output of both renders in each line, so moving the
+ * selection back and forth doesn't encode the lines again.
+ *
+ * @param index line to select
+ */
+void Menu::selectLine(unsigned int index) {
+  if ((int)index == rendered)
+    return;
+  renderFunction render = selectedRender;
+  std::shared_ptr<const RenderRule> rule = selectedRule;
+  // The line gets the selected render, and render has its unselected one.
+  lines[index]->swapRender(render, rule);
+  lines[rendered]->swapRender(render, rule);
+  rendered = index;
 }
 
 /**
@@ -711,29 +1391,51 @@ void Menu::setRender(bool selected, renderFunction render) {
  */
 renderFunction Menu::makeRender(ANSIColor c1, ANSIColor c2, ANSIColor c3,
                                 ANSIColor c4) {
-  renderFunction render = [c1, c2, c3, c4](const std::string &txt) -> Render {
-    Render r(txt);
-
-    bool option = true;
-    for (char const &c : txt) {
-      if (option) {
-        if (c == '[' or c == ']') {
-          r.append(c1);
-          option = (c == '[');
-        } else {
-          r.append(c2);
-        }
-      } else {
-        if (isupper(c))
-          r.append(c3);
-        else
-          r.append(c4);
-      }
+  return makeRule(c1, c2, c3, c4);
+}
+
+/**
+ * make RenderRule for menus, the same colors as makeRender().
+ *
+ * Use with Menu::setRender(bool, const RenderRule &).
+ */
+RenderRule Menu::makeRule(ANSIColor c1, ANSIColor c2, ANSIColor c3,
+                          ANSIColor c4) {
+  return RenderRule(c4).upper(c3).option(c1, c2);
+}
+
+/**
+ * @brief Type-ahead for a key.
+ *
+ * Printable keys that aren't reserved (hotkeys, number pad) narrow the
+ * search, space only once something was typed.  If nothing matches, the
+ * search starts again with the key.
+ * Backspace removes the last key typed.  Any other key ends the search.
+ *
+ * @param search PrefixIndex
+ * @param event key
+ * @param reserved is the key used for something else?
+ * @return true if the key was used
+ */
+static bool typeAhead(PrefixIndex &search, int event, bool reserved) {
+  if ((event == 0x08) or (event == XKEY_DELETE))
+    return search.back();
+
+  bool typing = (event > 0x20) or
+                ((event == 0x20) and !search.getPrefix().empty());
+  if (typing and (event < 0x7f) and !reserved) {
+    if (search.getPrefix().empty())
+      search.reset();
+    if (!search.narrow(event)) {
+      search.reset();
+      search.narrow(event);
     }
+    return true;
+  }
 
-    return r;
-  };
-  return render;
+  if (!search.getPrefix().empty())
+    search.reset();
+  return false;
 }
 
 /*
@@ -742,52 +1444,43 @@ renderFunction Menu::makeRender(ANSIColor c1, ANSIColor c2, ANSIColor c3,
  */
 
 /**
- * @todo Fix this, so it only updates the lines that have been changed when
- * the user selects something.  Also, add the "Up/Down Move" maybe to the
- * bottom?
+ * @brief Choose an option.
  *
- * Needs timeout.
- *
- * Should we return the index offset, or return the actual char?  (Like in
- * the case of Quit or Help?)
+ * Up/Down (or 8/2 on the number pad, when they aren't options), Home and
+ * End move the selection, Enter or an option's key chooses.  Only the
+ * two lines that change are output.
  *
  * @param door
- * @return int
+ * @return int option + 1, or < 0 for a timeout.
  */
 int Menu::choose(Door &door) {
   // Display menu and make a choice
   // step 1:  fix up the lines
 
-  bool updated = true;
+  bool updated = false;
   bool update_and_exit = false;
-  std::set<int> changed;
+  unsigned int previous_choice = chosen;
+
+  // The lines keep their renders (and encoded output) between calls.
+  if (rendered < 0)
+    renderLines();
+  else
+    selectLine(chosen);
 
   door::ANSIColor blank(door::COLOR::BLACK); // , door::COLOR::BLACK);
+  // this outputs the entire menu
+  door << *this << blank;
+
   while (true) {
     if (updated) {
-      for (unsigned int x = 0; x < lines.size(); ++x) {
-        if (x == chosen) {
-          lines[x]->setRender(
-              selectedRender); // setColorize(selectedColorizer);
-        } else {
-          lines[x]->setRender(
-              unselectedRender); // setColorize(unselectedColorizer);
-        }
-      }
-      // this outputs the entire menu
-      if (changed.empty())
-        door << *this << blank;
-      else {
-        // update just the lines that have changed.
-        for (auto si : changed) {
-          // *this->update(door, si);
-          update(door, si);
-        }
-        // Cursor is positioned at the end of the panel/menu.
-        // The cursor changes colors as you arrow up or down.
-        // Interesting!
-        door << gotoEnd() << blank;
-      }
+      // update just the lines that have changed.
+      selectLine(chosen);
+      update(door, previous_choice);
+      update(door, chosen);
+      // Cursor is positioned at the end of the panel/menu.
+      // The cursor changes colors as you arrow up or down.
+      // Interesting!
+      door << gotoEnd() << blank;
       // door << flush;
       // door.update();
     };
@@ -807,15 +1500,16 @@ int Menu::choose(Door &door) {
       return event;
     }
 
-    unsigned int previous_choice = chosen;
-    changed.clear();
-
-    bool use_numberpad = true;
+    previous_choice = chosen;
 
-    // Don't use the numberpad, if any of the options are 8 or 2 (up/down)
-    for (const char &c : options) {
-      if ((c == '8') or (c == '2'))
-        use_numberpad = false;
+    bool reserved = ((event < 256) and (hotkeys[toupper(event)] >= 0)) or
+                    (use_numberpad and ((event == '8') or (event == '2')));
+    if (typeAhead(search, event, reserved)) {
+      if (!search.getPrefix().empty())
+        chosen = search.match();
+      if (previous_choice != chosen)
+        updated = true;
+      continue;
     }
 
     switch (event) {
@@ -825,7 +1519,6 @@ int Menu::choose(Door &door) {
     case XKEY_UP_ARROW:
       if (chosen > 0) {
         chosen--;
-        updated = true;
       }
       break;
 
@@ -835,46 +1528,34 @@ int Menu::choose(Door &door) {
     case XKEY_DOWN_ARROW:
       if (chosen < lines.size() - 1) {
         chosen++;
-        updated = true;
       }
       break;
 
     case XKEY_HOME:
-      if (chosen != 0) {
-        chosen = 0;
-        updated = true;
-      }
+      chosen = 0;
       break;
     case XKEY_END:
-      if (chosen != lines.size() - 1) {
-        chosen = lines.size() - 1;
-        updated = true;
-      }
+      chosen = lines.size() - 1;
     }
     if (event == 0x0d) {
       // ENTER -- use current selection
       return chosen + 1;
     }
 
-    for (unsigned int x = 0; x < lines.size(); x++) {
-      if (toupper(options[x]) == toupper(event)) {
-        // is the selected one current chosen?
-
-        if (chosen == x) {
-          return x + 1;
-        }
-        // No, it isn't!
-        // Update the screen, and then exit
-        updated = true;
-        chosen = x;
-        update_and_exit = true;
+    if ((event < 256) and (hotkeys[toupper(event)] >= 0)) {
+      unsigned int x = hotkeys[toupper(event)];
+      // is the selected one current chosen?
+      if (chosen == x) {
+        return x + 1;
       }
+      // No, it isn't!
+      // Update the screen, and then exit
+      chosen = x;
+      update_and_exit = true;
     }
 
-    if (previous_choice != chosen) {
-      changed.insert(previous_choice);
-      changed.insert(chosen);
-    }
+    if (previous_choice != chosen)
+      updated = true;
   }
 
   return 0;
@@ -889,8 +1570,315 @@ Screen::Screen(Screen &s) {
 }
 */
 
+/**
+ * @brief Add a panel, on top of the others.
+ *
+ * @param p Panel
+ */
 void Screen::addPanel(std::unique_ptr<Panel> p) {
+  p->screen = this;
   panels.push_back(std::move(p));
+  restack();
+}
+
+/**
+ * @brief Find the z-order of a panel.
+ *
+ * @param p Panel
+ * @return std::size_t index, or panels.size() if not found.
+ */
+std::size_t Screen::indexOf(const Panel *p) const {
+  std::size_t i = 0;
+  for (; i < panels.size(); ++i) {
+    if (panels[i].get() == p)
+      break;
+  }
+  return i;
+}
+
+/**
+ * @brief Do the panels' screen areas overlap?
+ */
+static bool overlaps(const Panel &a, const Panel &b) {
+  int al, at, ar, ab;
+  int bl, bt, br, bb;
+  a.frame(al, at, ar, ab);
+  b.frame(bl, bt, br, bb);
+  return not((ar < bl) or (br < al) or (ab < bt) or (bb < at));
+}
+
+/**
+ * @brief Is part of the panel covered by a visible panel above it?
+ *
+ * @param index z-order of the panel
+ * @return bool
+ */
+bool Screen::covered(std::size_t index) const {
+  for (std::size_t j = index + 1; j < panels.size(); ++j) {
+    if (!panels[j]->hidden and overlaps(*panels[index], *panels[j]))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Update which panels are occluded.
+ *
+ * Called when the panels are added, removed, hidden, shown or moved.
+ */
+void Screen::restack(void) {
+  for (std::size_t i = 0; i < panels.size(); ++i)
+    panels[i]->occluded = covered(i);
+  stackValid = true;
+}
+
+/**
+ * @brief Remove columns from first, last column spans.
+ *
+ * @param spans column spans
+ * @param from,to columns to remove (inclusive)
+ */
+void Screen::cutSpans(Spans &spans, int from, int to) {
+  std::size_t i = 0;
+  while (i < spans.size()) {
+    std::pair<int, int> &span = spans[i];
+    if ((to < span.first) or (from > span.second)) {
+      ++i;
+    } else if ((from <= span.first) and (to >= span.second)) {
+      spans.erase(spans.begin() + i);
+    } else if ((from > span.first) and (to < span.second)) {
+      std::pair<int, int> right(to + 1, span.second);
+      span.second = from - 1;
+      spans.insert(spans.begin() + i + 1, right);
+      i += 2;
+    } else {
+      if (from <= span.first)
+        span.first = to + 1;
+      else
+        span.second = from - 1;
+      ++i;
+    }
+  }
+}
+
+/**
+ * @brief The visible columns of a panel on a screen row.
+ *
+ * @param index z-order of the panel
+ * @param row screen row
+ * @param left,right columns to look at (inclusive)
+ * @param out column spans that aren't covered
+ */
+void Screen::visibleSpans(std::size_t index, int row, int left, int right,
+                          Spans &out) const {
+  out.clear();
+  const Panel &p = *panels[index];
+  int pl, pt, pr, pb;
+  p.frame(pl, pt, pr, pb);
+  if (p.hidden or (row < pt) or (row > pb))
+    return;
+  int from = std::max(pl, left);
+  int to = std::min(pr, right);
+  if (from > to)
+    return;
+  out.push_back(std::make_pair(from, to));
+
+  for (std::size_t j = index + 1; j < panels.size(); ++j) {
+    const Panel &above = *panels[j];
+    int al, at, ar, ab;
+    above.frame(al, at, ar, ab);
+    if (above.hidden or (row < at) or (row > ab))
+      continue;
+    cutSpans(out, al, ar);
+    if (out.empty())
+      return;
+  }
+}
+
+/**
+ * @brief Output column spans of a panel's row.
+ *
+ * @param os
+ * @param index z-order of the panel
+ * @param row screen row
+ * @param spans column spans
+ */
+void Screen::paintSpans(std::ostream &os, std::size_t index, int row,
+                        const Spans &spans) const {
+  if (spans.empty())
+    return;
+  const Panel &p = *panels[index];
+  p.rowCells(row - p.y, cells);
+  for (const auto &span : spans) {
+    os << Goto(span.first, row);
+    for (int c = span.first; c <= span.second; ++c) {
+      std::size_t i = c - p.x;
+      if (i >= cells.size())
+        break;
+      os << cells[i].color;
+      os.write(cells[i].ch, cells[i].len);
+    }
+  }
+}
+
+/**
+ * @brief Output the visible part of a line of an occluded panel.
+ *
+ * @param d Door
+ * @param p Panel
+ * @param index line index
+ */
+void Screen::paintLine(Door &d, const Panel &p, int index) const {
+  std::size_t i = indexOf(&p);
+  if (i == panels.size())
+    return;
+  Spans spans{frameAllocator<Spans::value_type>()};
+  int col, row;
+  p.linePosition(index, col, row);
+  visibleSpans(i, row, col, col + p.width - 1, spans);
+  paintSpans(d, i, row, spans);
+}
+
+/**
+ * @brief Output an area of the screen.
+ *
+ * Each column is output from the top visible panel, columns without a
+ * panel are cleared.
+ *
+ * @param os
+ * @param left,top,right,bottom corners (inclusive)
+ */
+void Screen::paint(std::ostream &os, int left, int top, int right,
+                   int bottom) const {
+  static const char spaces[] = "                                ";
+  FrameScope frame;
+  Spans spans{frameAllocator<Spans::value_type>()};
+  Spans blank{frameAllocator<Spans::value_type>()};
+
+  for (int row = top; row <= bottom; ++row) {
+    blank.clear();
+    blank.push_back(std::make_pair(left, right));
+    for (std::size_t i = 0; i < panels.size(); ++i) {
+      const Panel &p = *panels[i];
+      int pl, pt, pr, pb;
+      p.frame(pl, pt, pr, pb);
+      if (p.hidden or (row < pt) or (row > pb))
+        continue;
+      visibleSpans(i, row, left, right, spans);
+      paintSpans(os, i, row, spans);
+      cutSpans(blank, pl, pr);
+    }
+
+    for (const auto &span : blank) {
+      os << Goto(span.first, row) << ANSIColor();
+      int pad = span.second - span.first + 1;
+      while (pad > 0) {
+        int chunk = std::min(pad, (int)sizeof(spaces) - 1);
+        os.write(spaces, chunk);
+        pad -= chunk;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Hide a panel, and output what it was covering.
+ *
+ * @param d Door
+ * @param p Panel
+ */
+void Screen::hide(Door &d, Panel *p) {
+  if ((indexOf(p) == panels.size()) or p->hidden)
+    return;
+  int left, top, right, bottom;
+  p->frame(left, top, right, bottom);
+  p->hide();
+  restack();
+  paint(d, left, top, right, bottom);
+}
+
+/**
+ * @brief Show a panel, only the parts that aren't covered are output.
+ *
+ * @param d Door
+ * @param p Panel
+ */
+void Screen::show(Door &d, Panel *p) {
+  std::size_t i = indexOf(p);
+  if ((i == panels.size()) or !p->hidden)
+    return;
+  p->show();
+  restack();
+
+  FrameScope frame;
+  Spans spans{frameAllocator<Spans::value_type>()};
+  int left, top, right, bottom;
+  p->frame(left, top, right, bottom);
+  for (int row = top; row <= bottom; ++row) {
+    visibleSpans(i, row, left, right, spans);
+    paintSpans(d, i, row, spans);
+  }
+}
+
+/**
+ * @brief Move a panel.
+ *
+ * The area it leaves is output from the panels under it (or cleared),
+ * then the visible parts of the panel are output.
+ *
+ * @param d Door
+ * @param p Panel
+ * @param x,y new position
+ */
+void Screen::move(Door &d, Panel *p, int x, int y) {
+  std::size_t i = indexOf(p);
+  if (i == panels.size())
+    return;
+  int oldLeft, oldTop, oldRight, oldBottom;
+  p->frame(oldLeft, oldTop, oldRight, oldBottom);
+  p->set(x, y);
+  restack();
+  if (p->hidden)
+    return;
+
+  paint(d, oldLeft, oldTop, oldRight, oldBottom);
+
+  // The old area already has the panel's new position in it.
+  FrameScope frame;
+  Spans spans{frameAllocator<Spans::value_type>()};
+  int left, top, right, bottom;
+  p->frame(left, top, right, bottom);
+  for (int row = top; row <= bottom; ++row) {
+    visibleSpans(i, row, left, right, spans);
+    if ((row >= oldTop) and (row <= oldBottom))
+      cutSpans(spans, oldLeft, oldRight);
+    paintSpans(d, i, row, spans);
+  }
+}
+
+/**
+ * @brief Remove a panel from the screen, and output what it was covering.
+ *
+ * @param d Door
+ * @param p Panel
+ * @return std::unique_ptr<Panel> the panel, or nullptr if not found.
+ */
+std::unique_ptr<Panel> Screen::close(Door &d, Panel *p) {
+  std::size_t i = indexOf(p);
+  if (i == panels.size())
+    return nullptr;
+  std::unique_ptr<Panel> closed = std::move(panels[i]);
+  panels.erase(panels.begin() + i);
+  closed->screen = nullptr;
+  closed->occluded = false;
+  restack();
+
+  if (!closed->hidden) {
+    int left, top, right, bottom;
+    closed->frame(left, top, right, bottom);
+    paint(d, left, top, right, bottom);
+  }
+  return closed;
 }
 
 /*
@@ -898,13 +1886,70 @@ void Screen::hide(void) { hidden = true; }
 void Screen::show(void) { hidden = false; }
 */
 
+/**
+ * @brief Output the changes of every panel.
+ *
+ * The panels report the columns that changed, which are output in row
+ * order.  Changes further along the same row move the cursor forward,
+ * instead of a Goto, or not at all when they are next to each other.
+ * Colors are only sent when they change.
+ *
+ * @param d Door
+ * @return true if anything was output
+ */
 bool Screen::update(Door &d) {
-  bool updated = false;
-  for (auto &panel : panels) {
-    if (panel->update(d))
-      updated = true;
+  // Panels could have been hidden, shown or moved directly.
+  if (!stackValid)
+    restack();
+
+  FrameScope frame;
+  Damages damages{frameAllocator<Damage>()};
+  damaged.clear();
+  for (auto &panel : panels)
+    panel->damage(damages, damaged);
+  if (damages.empty())
+    return false;
+
+  std::sort(damages.begin(), damages.end(),
+            [](const Damage &a, const Damage &b) {
+              if (a.row != b.row)
+                return a.row < b.row;
+              if (a.first != b.first)
+                return a.first < b.first;
+              return a.cell < b.cell;
+            });
+
+  // The cursor position isn't known until the first Goto.
+  int row = -1;
+  int col = -1;
+  Spans spans{frameAllocator<Spans::value_type>()};
+  for (const Damage &damage : damages) {
+    spans.clear();
+    std::size_t i = indexOf(damage.panel);
+    if ((i != panels.size()) and panels[i]->occluded)
+      visibleSpans(i, damage.row, damage.first, damage.last, spans);
+    else
+      spans.push_back(std::make_pair(damage.first, damage.last));
+
+    for (const auto &span : spans) {
+      if ((row == damage.row) and (col < span.first)) {
+        // Further along the row, move forward (shorter than a Goto).
+        d << CSI;
+        if (span.first - col > 1)
+          d << span.first - col;
+        d << 'C';
+      } else if ((row != damage.row) or (col != span.first))
+        d << Goto(span.first, damage.row);
+      for (int c = span.first; c <= span.second; ++c) {
+        const Line::Cell &cell = damaged[damage.cell + c - damage.first];
+        d << cell.color;
+        d.write(cell.ch, cell.len);
+      }
+      row = damage.row;
+      col = span.second + 1;
+    }
   }
-  return updated;
+  return true;
 }
 
 void Screen::update(void) {
@@ -916,7 +1961,8 @@ void Screen::update(void) {
 /**
  * @brief Outputs screen to stream.
  *
- * This iterates over panels, and outputs them.
+ * This iterates over panels, and outputs them.  Panels covered by others
+ * only output the columns that are visible.
  * See \ref door::Panel
  *
  * @param[in,out] os Stream
@@ -925,12 +1971,1217 @@ void Screen::update(void) {
  */
 std::ostream &operator<<(std::ostream &os, const Screen &s) {
   // if (!s.hidden) {
-  for (auto &panel : s.panels) {
-    os << *panel;
-  };
+  s.output(os);
   // os << flush;
   // }
   return os;
 }
 
+/**
+ * @brief Output the panels, in z-order.
+ *
+ * @param os
+ */
+void Screen::output(std::ostream &os) const {
+  FrameScope frame;
+  Spans spans{frameAllocator<Spans::value_type>()};
+  for (std::size_t i = 0; i < panels.size(); ++i) {
+    const Panel &panel = *panels[i];
+    if (panel.hidden)
+      continue;
+    if (!covered(i)) {
+      os << panel;
+      continue;
+    }
+    int left, top, right, bottom;
+    panel.frame(left, top, right, bottom);
+    for (int row = top; row <= bottom; ++row) {
+      visibleSpans(i, row, left, right, spans);
+      paintSpans(os, i, row, spans);
+    }
+  }
+}
+
+/**
+ * @brief Construct a new PackedPanel
+ *
+ * @param x,y screen position
+ * @param width width of the lines
+ * @param rows number of rows shown
+ */
+PackedPanel::PackedPanel(int x, int y, int width, int rows)
+    : Panel(x, y, width), top{0}, rows{rows} {}
+
+/**
+ * @brief Rows shown
+ *
+ * @return int
+ */
+int PackedPanel::rowCount(void) const { return rows; }
+
+/**
+ * @brief Add a RenderRule for lines to use.
+ *
+ * There can be up to NO_RULE rules.
+ *
+ * @param rule RenderRule
+ * @return int rule index for append()
+ */
+int PackedPanel::addRule(const RenderRule &rule) {
+  assert(rules.size() < NO_RULE);
+  rules.push_back(rule);
+  return rules.size() - 1;
+}
+
+/**
+ * @brief Number of columns in text.
+ */
+static std::uint32_t textColumns(const char *cp, std::size_t len) {
+  if (!unicode)
+    return len;
+  std::uint32_t cols = 0;
+  for (std::size_t i = 0; i < len; ++i) {
+    // Count everything but UTF-8 continuation bytes
+    if ((cp[i] & 0xc0) != 0x80)
+      ++cols;
+  }
+  return cols;
+}
+
+/**
+ * @brief Add a line.
+ *
+ * @param text line text
+ * @param color line color
+ * @param rule index from addRule(), or -1 to use the color
+ */
+void PackedPanel::append(const std::string &text, PackedColor color,
+                         int rule) {
+  assert((rule < 0) or (rule < (int)rules.size()));
+  starts.push_back(pool.length());
+  lengths.push_back(text.length());
+  capacities.push_back(text.length());
+  columns.push_back(textColumns(text.data(), text.length()));
+  colors.push_back(color);
+  ruleIndex.push_back(rule < 0 ? NO_RULE : rule);
+  pool.append(text);
+}
+
+/**
+ * @brief Change the text of a line.
+ *
+ * The text is replaced in the line's slot if it fits, otherwise it gets
+ * a new slot at the end of the pool.  A slot keeps its size when the
+ * text gets shorter, so text that changes between two lengths stays in
+ * place.  When more than half of the pool is abandoned slots, the pool
+ * is compacted.  A visible line is output on the next update.
+ *
+ * @param line line index
+ * @param text new text
+ */
+void PackedPanel::setText(int line, const std::string &text) {
+  if (text.length() <= capacities[line]) {
+    pool.replace(starts[line], text.length(), text);
+  } else {
+    abandoned += capacities[line];
+    starts[line] = pool.length();
+    capacities[line] = text.length();
+    pool.append(text);
+  }
+  lengths[line] = text.length();
+  columns[line] = textColumns(text.data(), text.length());
+
+  if ((line >= top) and (line < top + rows))
+    changed.push_back(line);
+  if (abandoned > pool.length() / 2)
+    compact();
+}
+
+/**
+ * @brief Copy the lines into a new pool, without the abandoned slots.
+ *
+ * Each line's slot is trimmed to its text.
+ */
+void PackedPanel::compact(void) {
+  std::string packed;
+  packed.reserve(pool.length() - abandoned);
+  for (std::size_t i = 0; i < starts.size(); ++i) {
+    std::uint32_t start = packed.length();
+    packed.append(pool, starts[i], lengths[i]);
+    starts[i] = start;
+    capacities[i] = lengths[i];
+  }
+  pool.swap(packed);
+  abandoned = 0;
+}
+
+/**
+ * @brief Remove all lines.
+ */
+void PackedPanel::clear(void) {
+  pool.clear();
+  starts.clear();
+  lengths.clear();
+  capacities.clear();
+  abandoned = 0;
+  columns.clear();
+  colors.clear();
+  ruleIndex.clear();
+  changed.clear();
+  top = 0;
+}
+
+/**
+ * @brief Text of a line.
+ *
+ * @param line line index
+ * @return std::string
+ */
+std::string PackedPanel::getText(int line) const {
+  return pool.substr(starts[line], lengths[line]);
+}
+
+/**
+ * @brief Columns of the widest line.
+ *
+ * @return int
+ */
+int PackedPanel::widest(void) const {
+  std::uint32_t most = 0;
+  for (std::uint32_t c : columns) {
+    if (c > most)
+      most = c;
+  }
+  return most;
+}
+
+/**
+ * @brief Set the first line shown.
+ *
+ * The panel needs to be output again.
+ *
+ * @param line line index
+ */
+void PackedPanel::scroll(int line) {
+  int last = (int)starts.size() - rows;
+  if (line > last)
+    line = last;
+  if (line < 0)
+    line = 0;
+  top = line;
+  changed.clear();
+}
+
+/**
+ * @brief Output a line, clipped or padded to the width.
+ *
+ * The cursor must be at the start of the line.  Rows past the last
+ * line are blank.
+ *
+ * @param os
+ * @param line line index
+ */
+void PackedPanel::outputRow(std::ostream &os, int line) const {
+  static const char spaces[] = "                                ";
+  std::size_t len = 0;
+  int cols = 0;
+
+  if (line < (int)starts.size()) {
+    const char *text = pool.data() + starts[line];
+    len = lengths[line];
+    cols = columns[line];
+
+    if (cols > width) {
+      // Clip to the width
+      if (unicode) {
+        int c = 0;
+        std::size_t i = 0;
+        for (; i < len; ++i) {
+          if ((text[i] & 0xc0) != 0x80) {
+            if (c == width)
+              break;
+            ++c;
+          }
+        }
+        len = i;
+      } else
+        len = width;
+      cols = width;
+    }
+
+    if (ruleIndex[line] != NO_RULE) {
+      const RenderRule &rule = rules[ruleIndex[line]];
+      rule.render(text, len, FrameArena::active()).output(os);
+    } else {
+      os << colors[line];
+      os.write(text, len);
+    }
+  } else {
+    os << PackedColor();
+  }
+
+  int pad = width - cols;
+  while (pad > 0) {
+    int chunk = std::min(pad, (int)sizeof(spaces) - 1);
+    os.write(spaces, chunk);
+    pad -= chunk;
+  }
+}
+
+/**
+ * @brief Report the rows changed by setText() to the Screen.
+ *
+ * @param out damage
+ * @param columns damaged columns
+ */
+void PackedPanel::damage(Damages &out, std::vector<Line::Cell> &columns) {
+  if (hidden)
+    return;
+
+  for (int line : changed) {
+    if ((line < top) or (line >= top + rows))
+      continue;
+    Damage damage;
+    linePosition(line - top, damage.first, damage.row);
+    damage.last = damage.first + width - 1;
+    damage.panel = this;
+    damage.cell = columns.size();
+    lineCells(line - top, columns);
+    out.push_back(damage);
+  }
+  changed.clear();
+}
+
+/**
+ * @brief Append the columns of a visible row, exactly width of them.
+ *
+ * @param index visible row
+ * @param out columns
+ */
+void PackedPanel::lineCells(int index, std::vector<Line::Cell> &out) const {
+  std::size_t start = out.size();
+  int line = top + index;
+
+  if (line < (int)starts.size()) {
+    const char *text = pool.data() + starts[line];
+    int len = lengths[line];
+    if (ruleIndex[line] != NO_RULE) {
+      Render r =
+          rules[ruleIndex[line]].render(text, len, FrameArena::active());
+      for (const ColorOutput &co : r.outputs) {
+        if (co.pos >= len)
+          break;
+        Line::appendCells(out, text + co.pos,
+                          text + co.pos + std::min(co.len, len - co.pos),
+                          co.color());
+      }
+    } else
+      Line::appendCells(out, text, text + len, colors[line].color());
+  }
+
+  if (out.size() > start + width)
+    out.resize(start + width);
+  Line::Cell blank;
+  blank.ch[0] = ' ';
+  blank.len = 1;
+  blank.color = PackedColor().color();
+  while (out.size() < start + width)
+    out.push_back(blank);
+}
+
+/**
+ * @brief Output the panel (borders and visible rows)
+ *
+ * @param os
+ */
+void PackedPanel::output(std::ostream &os) const {
+  int style = (int)border_style;
+  int row = y;
+  int col = x;
+  box_styles s{};
+
+  if (style > 0) {
+    s = borderStyle(style);
+    outputTop(os);
+    ++row;
+    ++col;
+  }
+
+  for (int r = 0; r < rows; ++r) {
+    if (style > 0)
+      os << door::Goto(x, row) << border_color << s.side;
+    else
+      os << door::Goto(col, row);
+    outputRow(os, top + r);
+    if (style > 0)
+      os << border_color << s.side;
+    ++row;
+  }
+
+  if (style > 0) {
+    os << door::Goto(x, row) << border_color;
+    os.write(stripBottom.data(), stripBottom.length());
+  }
+}
+
+/**
+ * @brief Output the lines changed by setText().
+ *
+ * @param d Door
+ * @return true if any lines were output
+ */
+bool PackedPanel::update(Door &d) {
+  if (changed.empty() or hidden)
+    return false;
+
+  FrameScope frame;
+  int col, row;
+  for (int line : changed) {
+    if ((line < top) or (line >= top + rows))
+      continue;
+    if (occluded) {
+      screen->paintLine(d, *this, line - top);
+      continue;
+    }
+    linePosition(line - top, col, row);
+    d << door::Goto(col, row);
+    outputRow(d, line);
+  }
+  changed.clear();
+  return true;
+}
+
+/**
+ * @brief Construct a new ListMenu
+ *
+ * @param x,y screen position
+ * @param width width of the items
+ * @param rows number of visible rows
+ * @param count number of items
+ * @param item text of an item
+ */
+ListMenu::ListMenu(int x, int y, int width, int rows, countFunction count,
+                   itemFunction item)
+    : Panel(x, y, width), count{count}, item{item}, rows{rows} {
+  setStyle(BorderStyle::DOUBLE);
+  setRender(true, Menu::defaultSelectedRender);
+  setRender(false, Menu::defaultUnselectedRender);
+  hotkeys.fill(-1);
+}
+
+/**
+ * @brief Set the item for a key (upper and lower case).
+ *
+ * @param key
+ * @param item
+ */
+void ListMenu::setHotkey(unsigned char key, int item) {
+  hotkeys[key] = item;
+  hotkeys[(unsigned char)toupper(key)] = item;
+  hotkeys[(unsigned char)tolower(key)] = item;
+}
+
+void ListMenu::setRender(bool selected, renderFunction render) {
+  if (selected)
+    selectedRender = render;
+  else
+    unselectedRender = render;
+}
+
+/**
+ * @brief Select an item, and scroll so it is visible.
+ *
+ * This doesn't output anything, use move() for that.
+ *
+ * @param item
+ */
+void ListMenu::select(int item) {
+  int total = count();
+  if (item >= total)
+    item = total - 1;
+  if (item < 0)
+    item = 0;
+  chosen = item;
+  if (chosen < top)
+    top = chosen;
+  if (chosen >= top + rows)
+    top = chosen - rows + 1;
+}
+
+/**
+ * @brief Keep the selection in the list, when it got shorter.
+ *
+ * @return int chosen item + 1, or 0 for an empty list.
+ */
+int ListMenu::clampChosen(void) {
+  int total = count();
+  if (total == 0)
+    return 0;
+  if (chosen >= total)
+    select(chosen);
+  return chosen + 1;
+}
+
+/**
+ * @brief Clip or pad text to exactly width columns.
+ *
+ * @param text
+ * @param width
+ */
+static void fitText(std::string &text, int width) {
+  int cols = 0;
+  if (unicode) {
+    std::size_t i = 0;
+    for (; i < text.length(); ++i) {
+      if ((text[i] & 0xc0) != 0x80) {
+        if (cols == width)
+          break;
+        ++cols;
+      }
+    }
+    text.resize(i);
+  } else {
+    if ((int)text.length() > width)
+      text.resize(width);
+    cols = text.length();
+  }
+  text.append(width - cols, ' ');
+}
+
+/**
+ * @brief The text of a visible row, clipped or padded to the width.
+ *
+ * @param row visible row
+ * @param total count()
+ * @param text
+ */
+void ListMenu::rowText(int row, int total, std::string &text) const {
+  int index = top + row;
+  text.clear();
+  if (index < total)
+    text = item(index);
+  fitText(text, width);
+}
+
+/**
+ * @brief Output a visible row (from shown).
+ *
+ * @param os
+ * @param row visible row
+ * @param border output the sides of the border too
+ */
+void ListMenu::outputRow(std::ostream &os, int row, bool border) const {
+  beginRow(os, row, border);
+  if (top + row == chosen)
+    selectedRender(shown[row]).output(os);
+  else
+    unselectedRender(shown[row]).output(os);
+  endRow(os, border);
+}
+
+/**
+ * @brief Output the rows that changed since they were output.
+ *
+ * When the menu is covered on its Screen, only the visible part of the
+ * rows is output.  Nothing is output while it is hidden.
+ *
+ * @param d Door
+ */
+void ListMenu::repaint(Door &d) {
+  if (hidden) {
+    // The rows are output again once it is shown.
+    shown.clear();
+    return;
+  }
+  FrameScope frame;
+  clampChosen();
+  int total = count();
+  if ((int)shown.size() != rows) {
+    shown.resize(rows);
+    shownState.assign(rows, -1);
+  }
+  for (int row = 0; row < rows; ++row) {
+    rowText(row, total, next);
+    signed char state = (top + row == chosen) ? 1 : 0;
+    if ((shownState[row] == state) and (shown[row] == next))
+      continue;
+    bool border = (shownState[row] < 0);
+    shown[row].swap(next);
+    shownState[row] = state;
+    if (occluded)
+      screen->paintLine(d, *this, row);
+    else
+      outputRow(d, row, border);
+  }
+}
+
+/**
+ * @brief Scroll the rows with the terminal, see Panel::scrollRows().
+ *
+ * The rows scrolled in are marked to be output.
+ *
+ * @param d Door
+ * @param lines number of rows to scroll up (or down, when negative)
+ * @return true if scrolled
+ */
+bool ListMenu::hardwareScroll(Door &d, int lines) {
+  if (((int)shown.size() != rows) or !scrollRows(d, rows, lines))
+    return false;
+
+  if (lines > 0) {
+    std::rotate(shown.begin(), shown.begin() + lines, shown.end());
+    std::rotate(shownState.begin(), shownState.begin() + lines,
+                shownState.end());
+    std::fill(shownState.end() - lines, shownState.end(), -1);
+  } else {
+    std::rotate(shown.begin(), shown.end() + lines, shown.end());
+    std::rotate(shownState.begin(), shownState.end() + lines,
+                shownState.end());
+    std::fill(shownState.begin(), shownState.begin() - lines, -1);
+  }
+  return true;
+}
+
+/**
+ * @brief Select an item, and output the changes.
+ *
+ * When the item isn't visible the rows are scrolled.
+ *
+ * @param d Door
+ * @param item
+ * @return true if the selection changed
+ */
+bool ListMenu::move(Door &d, int item) {
+  int total = count();
+  if (total == 0)
+    return false;
+  if (item >= total)
+    item = total - 1;
+  if (item < 0)
+    item = 0;
+  if (item == chosen)
+    return false;
+
+  int was = top;
+  select(item);
+  if (top != was)
+    hardwareScroll(d, top - was);
+  repaint(d);
+  return true;
+}
+
+/**
+ * @brief Output the menu (borders and visible rows)
+ *
+ * @param os
+ */
+void ListMenu::output(std::ostream &os) const {
+  int style = (int)border_style;
+  int total = count();
+  shown.resize(rows);
+  shownState.resize(rows);
+
+  if (style > 0)
+    outputTop(os);
+
+  for (int row = 0; row < rows; ++row) {
+    rowText(row, total, shown[row]);
+    shownState[row] = (top + row == chosen) ? 1 : 0;
+    outputRow(os, row, true);
+  }
+
+  if (style > 0) {
+    os << door::Goto(x, y + rows + 1) << border_color;
+    os.write(stripBottom.data(), stripBottom.length());
+  }
+}
+
+/**
+ * @brief Append the columns of a visible row, exactly width of them.
+ *
+ * @param index visible row
+ * @param out columns
+ */
+void ListMenu::lineCells(int index, std::vector<Line::Cell> &out) const {
+  std::string text;
+  rowText(index, count(), text);
+  Render r = (top + index == chosen) ? selectedRender(text)
+                                     : unselectedRender(text);
+  int len = text.length();
+  for (const ColorOutput &co : r.outputs) {
+    if (co.pos >= len)
+      break;
+    Line::appendCells(out, text.data() + co.pos,
+                      text.data() + co.pos + std::min(co.len, len - co.pos),
+                      co.color());
+  }
+}
+
+/**
+ * @brief Build the type-ahead index, from every item.
+ *
+ * This is done when type-ahead is first used, and again when the items
+ * change (see invalidate) or the number of items changes.
+ */
+void ListMenu::indexItems(void) {
+  search.clear();
+  int total = count();
+  for (int i = 0; i < total; ++i)
+    search.add(item(i), i);
+  search.reset();
+  indexed = true;
+}
+
+/**
+ * @brief The items changed.
+ *
+ * The type-ahead index is built again when it is next used.
+ */
+void ListMenu::invalidate(void) {
+  search.clear();
+  indexed = false;
+}
+
+/**
+ * @brief Choose an item.
+ *
+ * Up/Down (or 8/2 on the number pad, when they aren't hotkeys), PgUp,
+ * PgDn, Home and End move the selection, Enter or a hotkey chooses.
+ * Typing other keys selects the first item starting with them.
+ *
+ * @param door Door
+ * @return int item + 1, 0 for an empty list, or < 0 for a timeout.
+ */
+int ListMenu::choose(Door &door) {
+  door::ANSIColor blank(door::COLOR::BLACK);
+  clampChosen();
+  door << *this << blank;
+  bool use_numberpad = (hotkeys['8'] < 0) and (hotkeys['2'] < 0);
+
+  while (true) {
+    int event = door.sleep_key(door.inactivity);
+    if (event < 0)
+      return event;
+
+    if (event == 0x0d)
+      return clampChosen();
+
+    if ((event < 256) and (hotkeys[event] >= 0)) {
+      if (move(door, hotkeys[event]))
+        door << gotoEnd() << blank;
+      return clampChosen();
+    }
+
+    bool numberpad = use_numberpad and ((event == '8') or (event == '2'));
+    if ((event > 0x20) and (event < 0x7f) and !numberpad and
+        (!indexed or (search.size() != (std::size_t)count())))
+      indexItems();
+    if (typeAhead(search, event, numberpad)) {
+      if (!search.getPrefix().empty() and move(door, search.match()))
+        door << gotoEnd() << blank;
+      continue;
+    }
+
+    int want = chosen;
+    switch (event) {
+    case '8':
+      if (!use_numberpad)
+        break;
+    case XKEY_UP_ARROW:
+      want = chosen - 1;
+      break;
+
+    case '2':
+      if (!use_numberpad)
+        break;
+    case XKEY_DOWN_ARROW:
+      want = chosen + 1;
+      break;
+
+    case XKEY_PGUP:
+      want = chosen - rows;
+      break;
+    case XKEY_PGDN:
+      want = chosen + rows;
+      break;
+    case XKEY_HOME:
+      want = 0;
+      break;
+    case XKEY_END:
+      want = count() - 1;
+      break;
+    }
+
+    if (move(door, want))
+      door << gotoEnd() << blank;
+  }
+}
+
+/**
+ * @brief Construct a new LogPanel
+ *
+ * @param x,y screen position
+ * @param width width of the lines
+ * @param rows number of visible rows (at least 1)
+ * @param keep lines kept (at least rows)
+ */
+LogPanel::LogPanel(int x, int y, int width, int rows, int keep)
+    : Panel(x, y, width), rows{rows} {
+  // add() wraps around history, and scrolling uses the last row.
+  if (this->rows < 1)
+    this->rows = 1;
+  if (keep < this->rows)
+    keep = this->rows;
+  history.resize(keep);
+}
+
+void LogPanel::setTextColor(ANSIColor c) { textColor = c; }
+
+/**
+ * @brief Add a line, without any output.
+ *
+ * Use this before the panel is output, or while it is hidden.
+ *
+ * @param text
+ */
+void LogPanel::add(const std::string &text) {
+  history[added % history.size()] = text;
+  ++added;
+}
+
+/**
+ * @brief The text of a visible row, clipped or padded to the width.
+ *
+ * The last row is the newest line.
+ *
+ * @param row visible row
+ * @param text
+ */
+void LogPanel::rowText(int row, std::string &text) const {
+  long index = added - rows + row;
+  text.clear();
+  if ((index >= 0) and (index >= added - (long)history.size()))
+    text = history[index % history.size()];
+  fitText(text, width);
+}
+
+/**
+ * @brief Output a visible row (from shown).
+ *
+ * @param os
+ * @param row visible row
+ * @param border output the sides of the border too
+ */
+void LogPanel::outputRow(std::ostream &os, int row, bool border) const {
+  beginRow(os, row, border);
+  os << textColor;
+  os.write(shown[row].data(), shown[row].length());
+  endRow(os, border);
+}
+
+/**
+ * @brief Output the rows that changed since they were output.
+ *
+ * When the panel is covered on its Screen, only the visible part of the
+ * rows is output.
+ *
+ * @param d Door
+ */
+void LogPanel::repaint(Door &d) {
+  for (int row = 0; row < rows; ++row) {
+    rowText(row, next);
+    if (shown[row] == next)
+      continue;
+    shown[row].swap(next);
+    if (occluded)
+      screen->paintLine(d, *this, row);
+    else
+      outputRow(d, row, false);
+  }
+}
+
+/**
+ * @brief Scroll the rows up one, with the terminal.
+ *
+ * The last row is left blank, for the new line.
+ *
+ * @param d Door
+ * @return true if scrolled
+ */
+bool LogPanel::hardwareScroll(Door &d) {
+  if (!scrollRows(d, rows, 1))
+    return false;
+  std::rotate(shown.begin(), shown.begin() + 1, shown.end());
+  return true;
+}
+
+/**
+ * @brief Add a line at the bottom, and output the changes.
+ *
+ * Nothing is output until the panel has been output (or it is on a
+ * Screen), or while it is hidden.  The terminal doesn't scroll a covered
+ * panel (see Panel::scrollRows).
+ *
+ * @param d Door
+ * @param text
+ */
+void LogPanel::append(Door &d, const std::string &text) {
+  add(text);
+  if (hidden)
+    return;
+  if ((int)shown.size() != rows) {
+    if (!screen)
+      return;
+    // The Screen output it, every row is output again.
+    shown.resize(rows);
+  }
+
+  if (hardwareScroll(d)) {
+    rowText(rows - 1, shown.back());
+    outputRow(d, rows - 1, true);
+  } else
+    repaint(d);
+}
+
+/**
+ * @brief Output the panel (borders and visible rows)
+ *
+ * @param os
+ */
+void LogPanel::output(std::ostream &os) const {
+  int style = (int)border_style;
+  shown.resize(rows);
+
+  if (style > 0)
+    outputTop(os);
+
+  for (int row = 0; row < rows; ++row) {
+    rowText(row, shown[row]);
+    outputRow(os, row, true);
+  }
+
+  if (style > 0) {
+    os << door::Goto(x, y + rows + 1) << border_color;
+    os.write(stripBottom.data(), stripBottom.length());
+  }
+}
+
+/**
+ * @brief Append the columns of a visible row, exactly width of them.
+ *
+ * @param index visible row
+ * @param out columns
+ */
+void LogPanel::lineCells(int index, std::vector<Line::Cell> &out) const {
+  std::string text;
+  rowText(index, text);
+  Line::appendCells(out, text.data(), text.data() + text.length(),
+                    textColor);
+}
+
+/**
+ * @brief Construct a new WrapPanel
+ *
+ * @param x,y screen position
+ * @param width width of the text
+ * @param rows number of visible rows
+ */
+WrapPanel::WrapPanel(int x, int y, int width, int rows)
+    : Panel(x, y, width), rows{rows} {}
+
+/**
+ * @brief The columns of text, on one line.
+ *
+ * With door::unicode, UTF-8 continuation bytes don't take a column.
+ *
+ * @param text
+ * @return int
+ */
+static int textColumns(const std::string &text) {
+  int columns = 0;
+  for (char c : text)
+    if (!unicode or ((c & 0xc0) != 0x80))
+      ++columns;
+  return columns;
+}
+
+/**
+ * @brief Add a paragraph at the end.
+ *
+ * An empty paragraph is a blank line.
+ *
+ * @param markup text with color codes (see compileMarkup)
+ */
+void WrapPanel::addParagraph(const std::string &markup) {
+  paragraphs.emplace_back();
+  setParagraph(paragraphs.size() - 1, markup);
+}
+
+/**
+ * @brief Change a paragraph.
+ *
+ * Only this paragraph is wrapped again.
+ *
+ * @param index paragraph
+ * @param markup text with color codes (see compileMarkup)
+ */
+void WrapPanel::setParagraph(int index, const std::string &markup) {
+  Paragraph &p = paragraphs[index];
+  Render r = compileMarkup(markup);
+  const ArenaString &text = r.getText();
+  p.text.assign(text.data(), text.length());
+  p.runs.assign(r.outputs.begin(), r.outputs.end());
+  p.columns = textColumns(p.text);
+  p.unicode = unicode;
+  p.wrapped = 0;
+  reflow = true;
+}
+
+/**
+ * @brief Change the width.
+ *
+ * Paragraphs are wrapped again when they are next shown.  The panel's
+ * area changed, so its Screen finds the occluded panels again.
+ *
+ * @param w width of the text
+ */
+void WrapPanel::setWidth(int w) {
+  if (w == width)
+    return;
+  width = w;
+  reflow = true;
+  restacked();
+}
+
+/**
+ * @brief Break a paragraph into lines.
+ *
+ * A paragraph that fits is one line, without looking at the text.
+ * Lines break after the spaces between words.  A word longer than the
+ * width is broken at the width.  Spaces at the start of a wrapped line
+ * are skipped.  The columns are counted again if door::unicode changed.
+ *
+ * @param p Paragraph
+ * @param width
+ */
+void WrapPanel::wrap(Paragraph &p, int width) {
+  if (p.unicode != unicode) {
+    p.columns = textColumns(p.text);
+    p.unicode = unicode;
+  }
+  p.breaks.clear();
+  p.breaks.push_back(0);
+  p.wrapped = width;
+  if (p.columns <= width)
+    return;
+
+  const char *text = p.text.data();
+  int length = p.text.length();
+  int start = 0;
+  int cols = 0;
+  // Start of the word after the last space (-1 for none)
+  int word = -1;
+
+  for (int pos = 0; pos < length; ++pos) {
+    // UTF-8 continuation bytes don't take a column.
+    if (unicode and ((text[pos] & 0xc0) == 0x80))
+      continue;
+
+    if (text[pos] == ' ') {
+      ++cols;
+      word = -1;
+      continue;
+    }
+    if ((word < 0) and (pos > start) and (text[pos - 1] == ' '))
+      word = pos;
+
+    if (cols >= width) {
+      // Break before the word, or here if it doesn't fit on a line.
+      int next = ((word > start) ? word : pos);
+      p.breaks.push_back(next);
+      start = next;
+      word = -1;
+      cols = 0;
+      // Count the columns of the word carried to the new line.
+      for (int i = next; i < pos; ++i)
+        if (!unicode or ((text[i] & 0xc0) != 0x80))
+          ++cols;
+    }
+    ++cols;
+  }
+}
+
+/**
+ * @brief Wrap the paragraphs that need it, and find the first line of
+ * each.
+ */
+void WrapPanel::layout(void) const {
+  if (!reflow and (layoutUnicode == unicode))
+    return;
+  firstLines.resize(paragraphs.size() + 1);
+  int line = 0;
+  for (std::size_t i = 0; i < paragraphs.size(); ++i) {
+    Paragraph &p = paragraphs[i];
+    if ((p.wrapped != width) or (p.unicode != unicode))
+      wrap(p, width);
+    firstLines[i] = line;
+    line += p.breaks.size();
+  }
+  firstLines.back() = line;
+  reflow = false;
+  layoutUnicode = unicode;
+}
+
+/**
+ * @brief The number of lines, once wrapped.
+ *
+ * @return int
+ */
+int WrapPanel::lineCount(void) const {
+  layout();
+  return firstLines.back();
+}
+
+/**
+ * @brief Find the text of a line.
+ *
+ * @param line
+ * @param[out] para paragraph
+ * @param[out] start,end text of the line
+ */
+void WrapPanel::lineRange(int line, int &para, int &start, int &end) const {
+  para = std::upper_bound(firstLines.begin(), firstLines.end() - 1, line) -
+         firstLines.begin() - 1;
+  const Paragraph &p = paragraphs[para];
+  int index = line - firstLines[para];
+  start = p.breaks[index];
+  end = (index + 1 < (int)p.breaks.size()) ? p.breaks[index + 1]
+                                           : (int)p.text.length();
+  // Spaces at the end of a line aren't shown.
+  while ((end > start) and (p.text[end - 1] == ' '))
+    --end;
+}
+
+/**
+ * @brief Append the columns of a visible row, exactly width of them.
+ *
+ * Padding uses the color at the end of the line.
+ *
+ * @param index visible row
+ * @param out columns
+ */
+void WrapPanel::lineCells(int index, std::vector<Line::Cell> &out) const {
+  layout();
+  std::size_t want = out.size() + width;
+  ANSIColor color = PackedColor().color();
+  int line = top + index;
+
+  if (line < firstLines.back()) {
+    int para, start, end;
+    lineRange(line, para, start, end);
+    const Paragraph &p = paragraphs[para];
+    const char *text = p.text.data();
+
+    for (const ColorOutput &co : p.runs) {
+      int from = std::max(co.pos, start);
+      int to = std::min(co.pos + co.len, end);
+      if (co.pos > end)
+        break;
+      color = co.color();
+      if (from < to)
+        Line::appendCells(out, text + from, text + to, color);
+    }
+    if (out.size() > want)
+      out.resize(want);
+  }
+
+  while (out.size() < want)
+    out.push_back({{' '}, 1, color});
+}
+
+/**
+ * @brief Output a visible row.
+ *
+ * @param os
+ * @param row visible row
+ * @param border output the sides of the border too
+ */
+void WrapPanel::outputRow(std::ostream &os, int row, bool border) const {
+  beginRow(os, row, border);
+  std::vector<Line::Cell> cells;
+  lineCells(row, cells);
+  outputCells(os, cells);
+  endRow(os, border);
+}
+
+/**
+ * @brief Show the text from a line, and output the changes.
+ *
+ * When the terminal can scroll the rows (see Panel::scrollRows), only
+ * the rows scrolled in are output.  When the panel is covered on its
+ * Screen, only the visible part of the rows is output.  Nothing is
+ * output until the panel has been output (or it is on a Screen), or
+ * while it is hidden.
+ *
+ * @param d Door
+ * @param line first line to show
+ * @return true if the first line shown changed
+ */
+bool WrapPanel::scroll(Door &d, int line) {
+  int last = std::max(0, lineCount() - rows);
+  if (line > last)
+    line = last;
+  if (line < 0)
+    line = 0;
+  if (line == top)
+    return false;
+  top = line;
+  if (hidden) {
+    // The rows are output again once it is shown.
+    shownTop = -1;
+    return true;
+  }
+  if ((shownTop < 0) and !screen)
+    return true;
+
+  // Without the rows shown, they are all output.
+  int lines = (shownTop < 0) ? rows : top - shownTop;
+  shownTop = top;
+  if (scrollRows(d, rows, lines)) {
+    int first = (lines > 0) ? rows - lines : 0;
+    int end = (lines > 0) ? rows : -lines;
+    for (int row = first; row < end; ++row)
+      outputRow(d, row, true);
+  } else {
+    for (int row = 0; row < rows; ++row) {
+      if (occluded)
+        screen->paintLine(d, *this, row);
+      else
+        outputRow(d, row, false);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Output the panel (borders and visible rows)
+ *
+ * @param os
+ */
+void WrapPanel::output(std::ostream &os) const {
+  int style = (int)border_style;
+
+  if (style > 0)
+    outputTop(os);
+
+  for (int row = 0; row < rows; ++row)
+    outputRow(os, row, true);
+
+  if (style > 0) {
+    os << door::Goto(x, y + rows + 1) << border_color;
+    os.write(stripBottom.data(), stripBottom.length());
+  }
+  shownTop = top;
+}
+
 } // namespace door
@@ -1,6 +1,27 @@
 #include "door.h"
 #include "gtest/gtest.h"
 
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+/// Count allocations while set.
+static bool counting_allocations = false;
+/// Number of allocations counted.
+static int allocations = 0;
+
+void *operator new(std::size_t size) {
+  if (counting_allocations)
+    ++allocations;
+  void *p = std::malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
 namespace {
 
 class DoorTest : public ::testing::Test {
@@ -73,6 +94,837 @@ TEST_F(DoorTest, BasicColorOut1) {
   d->debug_buffer.clear();
 }
 
+TEST_F(DoorTest, PackedColorRoundTrip) {
+  door::ANSIColor YonB(door::COLOR::YELLOW, door::COLOR::BLUE,
+                       door::ATTR::BOLD, door::ATTR::BLINK);
+  door::PackedColor packed(YonB);
+  EXPECT_EQ(packed.value, 0x80 | 0x40 | 0x08 | 0x03);
+  EXPECT_TRUE(packed.color() == YonB);
+
+  // INVERSE is folded in by swapping foreground and background.
+  door::PackedColor inverse(door::ANSIColor("RED ON GREEN INVERSE"));
+  EXPECT_EQ(inverse.fg(), door::COLOR::GREEN);
+  EXPECT_EQ(inverse.bg(), door::COLOR::RED);
+
+  door::ANSIColor RonB(door::COLOR::RED, door::COLOR::BLUE);
+  *d << RonB;
+  d->debug_buffer.clear();
+  *d << door::PackedColor(
+      door::ANSIColor(door::COLOR::GREEN, door::COLOR::BLUE));
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[32m");
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, ColorTextOutput) {
+  *d << DOOR_TEXT("BRI WHI ON BLU", "Press a key");
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[0;1;37;44mPress a key");
+  d->debug_buffer.clear();
+
+  // previous was updated, so nothing needs to be sent.
+  *d << door::ANSIColor(door::COLOR::WHITE, door::COLOR::BLUE,
+                        door::ATTR::BOLD);
+  EXPECT_STREQ(d->debug_buffer.c_str(), "");
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, MarkupLine) {
+  door::Line line("");
+  line.setMarkup("|14Hi |07there|04@X1FX");
+  EXPECT_STREQ(line.getText(), "Hi thereX");
+  *d << line;
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[1;33mHi \x1b[0mthere\x1b[1;44mX");
+  *d << door::reset;
+  d->debug_buffer.clear();
+
+  door::Render r = door::compileMarkup("|12|20Red\x03" "4Blue|99");
+  EXPECT_EQ(r.getText(), "RedBlue|99");
+  ASSERT_EQ(r.outputs.size(), 2u);
+  EXPECT_EQ(r.outputs[0].len, 3);
+  EXPECT_EQ(r.outputs[1].c, door::PackedColor(door::COLOR::WHITE,
+                                              door::COLOR::BLUE, true));
+}
+
+TEST_F(DoorTest, RenderOutput) {
+  door::Render r("Hello");
+  r.append(door::PackedColor(door::COLOR::RED, door::COLOR::BLACK), 2);
+  r.append(door::PackedColor(door::COLOR::BLUE, door::COLOR::BLACK), 10);
+  r.output(*d);
+  // The last fragment is clipped to the text.
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[31mHe\x1b[34mllo");
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, RenderBuild) {
+  door::PackedColor red(door::COLOR::RED, door::COLOR::BLACK);
+  door::PackedColor palette[3] = {red, red, door::PackedColor()};
+  const unsigned char index[6] = {0, 1, 0, 2, 2, 0};
+
+  door::Render r("ABCDEF");
+  r.build(index, palette);
+  ASSERT_EQ(r.outputs.size(), 3u);
+  EXPECT_EQ(r.outputs[0].len, 3);
+  EXPECT_EQ(r.outputs[1].pos, 3);
+  EXPECT_EQ(r.outputs[2].len, 1);
+
+  door::Render menu =
+      door::Menu::makeRender(door::ANSIColor(door::COLOR::RED),
+                             door::ANSIColor(door::COLOR::GREEN),
+                             door::ANSIColor(door::COLOR::BLUE),
+                             door::ANSIColor(door::COLOR::CYAN))("[A] Add");
+  // [ A ] " " A dd
+  ASSERT_EQ(menu.outputs.size(), 6u);
+  EXPECT_EQ(menu.outputs[4].len, 1);
+  EXPECT_EQ(menu.outputs[5].len, 2);
+}
+
+TEST_F(DoorTest, RenderRuleLine) {
+  door::RenderRule rule(door::ANSIColor(door::COLOR::WHITE));
+  rule.digit(door::ANSIColor(door::COLOR::GREEN));
+
+  door::Line line("Lvl 42");
+  line.setRender(rule);
+  EXPECT_TRUE(line.hasRender());
+  *d << line;
+  EXPECT_STREQ(d->debug_buffer.c_str(), "Lvl \x1b[32m42");
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, LineEncodedCache) {
+  int calls = 0;
+  door::renderFunction counter = [&calls](const std::string &txt) {
+    ++calls;
+    door::Render r(txt);
+    r.append(door::ANSIColor(door::COLOR::RED), txt.length());
+    return r;
+  };
+  door::Line line("Cache", 0, counter);
+
+  *d << line << door::reset;
+  d->debug_buffer.clear();
+  *d << line << door::reset;
+  EXPECT_EQ(calls, 1);
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[31mCache\x1b[0m");
+  d->debug_buffer.clear();
+
+  // Different starting color, or changed text, renders again.
+  *d << door::ANSIColor(door::COLOR::RED) << line;
+  EXPECT_EQ(calls, 2);
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[31mCache");
+  line.setText("Again");
+  *d << line << door::reset;
+  EXPECT_EQ(calls, 3);
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, PanelPartialUpdate) {
+  int score = 1200;
+  door::updateFunction scoreText = [&score](void) -> std::string {
+    return "Score: " + std::to_string(score);
+  };
+
+  door::Panel panel(1, 1, 12);
+  std::unique_ptr<door::Line> line = std::make_unique<door::Line>(
+      scoreText(), 12, door::ANSIColor(door::COLOR::GREEN));
+  line->setUpdater(scoreText);
+  panel.addLine(std::move(line));
+
+  *d << panel;
+  d->debug_buffer.clear();
+
+  score = 1210;
+  EXPECT_TRUE(panel.update(*d));
+  // Only the changed digit is sent.
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[;10H1");
+  d->debug_buffer.clear();
+
+  EXPECT_FALSE(panel.update(*d));
+  EXPECT_TRUE(d->debug_buffer.empty());
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, PanelImage) {
+  int hp = 9;
+  door::Panel panel(1, 1, 5);
+  panel.setStyle(door::BorderStyle::SINGLE);
+  std::shared_ptr<door::Line> name = std::make_shared<door::Line>("Name", 5);
+  panel.addLine(name);
+  std::unique_ptr<door::Line> line = std::make_unique<door::Line>(
+      "Hp 9", 5, door::ANSIColor(door::COLOR::GREEN));
+  line->setUpdater([&hp](void) -> std::string {
+    return "Hp " + std::to_string(hp);
+  });
+  panel.addLine(std::move(line));
+
+  *d << door::reset << panel;
+  std::string first = d->debug_buffer;
+  d->debug_buffer.clear();
+
+  // The image is reused, the updater line is output again.
+  hp = 7;
+  panel.update();
+  *d << door::reset << panel;
+  first.replace(first.find("Hp 9"), 4, "Hp 7");
+  EXPECT_EQ(d->debug_buffer, first);
+  d->debug_buffer.clear();
+  // The changed line was output with the panel.
+  EXPECT_FALSE(panel.update(*d));
+  EXPECT_TRUE(d->debug_buffer.empty());
+
+  // Changing a static line makes a new image.
+  name->setText("Bob");
+  *d << door::reset << panel;
+  first.replace(first.find("Name "), 5, "Bob");
+  EXPECT_EQ(d->debug_buffer, first);
+  d->debug_buffer.clear();
+
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, ScreenOcclusion) {
+  door::Screen screen;
+  std::unique_ptr<door::Panel> board = std::make_unique<door::Panel>(1, 1, 6);
+  board->addLine(std::make_unique<door::Line>("aaaaaa", 6));
+  board->addLine(std::make_unique<door::Line>("bbbbbb", 6));
+  std::unique_ptr<door::Panel> popup = std::make_unique<door::Panel>(3, 1, 2);
+  popup->addLine(std::make_unique<door::Line>("XY", 2));
+  door::Panel *shown = popup.get();
+  screen.addPanel(std::move(board));
+  screen.addPanel(std::move(popup));
+
+  // The covered columns of the board aren't output.
+  *d << screen;
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[Haa\x1b[;5Haa\x1b[2Hbbbbbb\x1b[;3HXY");
+  d->debug_buffer.clear();
+
+  // Only the area under the popup is output.
+  screen.hide(*d, shown);
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[;3Haa");
+  d->debug_buffer.clear();
+
+  screen.show(*d, shown);
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[;3HXY");
+  d->debug_buffer.clear();
+
+  std::unique_ptr<door::Panel> closed = screen.close(*d, shown);
+  EXPECT_EQ(closed.get(), shown);
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[;3Haa");
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, ScreenDamage) {
+  std::string top = "abcd", second = "1234", right = "efgh";
+  auto polled = [](std::string &value) -> std::unique_ptr<door::Line> {
+    std::unique_ptr<door::Line> line =
+        std::make_unique<door::Line>(value, 4);
+    line->setUpdater([&value](void) -> std::string { return value; });
+    return line;
+  };
+
+  door::Screen screen;
+  std::unique_ptr<door::Panel> left = std::make_unique<door::Panel>(1, 1, 4);
+  left->addLine(polled(top));
+  left->addLine(polled(second));
+  std::unique_ptr<door::Panel> side = std::make_unique<door::Panel>(5, 1, 4);
+  side->addLine(polled(right));
+  screen.addPanel(std::move(left));
+  screen.addPanel(std::move(side));
+  *d << screen;
+  d->debug_buffer.clear();
+  EXPECT_FALSE(screen.update(*d));
+
+  // Row order, and no cursor movement between neighbouring changes.
+  second = "1239";
+  top = "abcX";
+  right = "Yfgh";
+  EXPECT_TRUE(screen.update(*d));
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[;4HXY\x1b[2;4H9");
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, ListMenu) {
+  door::PackedColor plain(door::COLOR::WHITE, door::COLOR::BLACK);
+  door::PackedColor bright(door::COLOR::BLACK, door::COLOR::WHITE);
+  int asked = 0;
+  door::ListMenu menu(1, 1, 6, 3, [](void) -> int { return 100000; },
+                      [&asked](int i) -> std::string {
+                        ++asked;
+                        return "Item " + std::to_string(i);
+                      });
+  menu.setStyle(door::BorderStyle::NONE);
+  menu.setRender(true, door::RenderRule(bright));
+  menu.setRender(false, door::RenderRule(plain));
+  menu.setHotkey('q', 99999);
+
+  // Only the visible items are asked for.
+  *d << menu;
+  EXPECT_EQ(asked, 3);
+  d->debug_buffer.clear();
+
+  // Without scrolling, only the rows that changed are output.
+  EXPECT_TRUE(menu.move(*d, 3));
+  EXPECT_EQ(menu.getTop(), 1);
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[HItem 1\x1b[2HItem 2\x1b[3H\x1b[30;47mItem 3");
+  d->debug_buffer.clear();
+
+  // The terminal scrolls, and the new row is output.
+  door::scroll_region = true;
+  d->width = 6;
+  EXPECT_TRUE(menu.move(*d, 4));
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[1;3r\x1b[H\x1b[1M\x1b[r"
+               "\x1b[2H\x1b[37;40mItem 3\x1b[3H\x1b[30;47mItem 4");
+  d->debug_buffer.clear();
+
+  // Not when the terminal width isn't known.
+  d->width = 0;
+  EXPECT_TRUE(menu.move(*d, 5));
+  EXPECT_EQ(d->debug_buffer.find("\x1b[1;3r"), std::string::npos);
+  d->debug_buffer.clear();
+  door::scroll_region = false;
+
+  EXPECT_TRUE(menu.move(*d, 99999));
+  EXPECT_EQ(menu.getTop(), 99997);
+
+  // A hotkey past the last item chooses the last item.
+  menu.setHotkey('z', 200000);
+  door::pushback.push_back('z');
+  EXPECT_EQ(menu.choose(*d), 100000);
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, LogPanel) {
+  door::LogPanel log(1, 1, 4, 2, 3);
+  log.add("one");
+  *d << log;
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[H    \x1b[2Hone ");
+  d->debug_buffer.clear();
+
+  // Not the full width, so the changed rows are output.
+  log.append(*d, "two");
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[Hone \x1b[2Htwo ");
+  d->debug_buffer.clear();
+
+  // The terminal scrolls, and only the new row is output.
+  door::scroll_region = true;
+  d->width = 4;
+  log.append(*d, "three");
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[1;2r\x1b[H\x1b[1M\x1b[r\x1b[2Hthre");
+  d->debug_buffer.clear();
+  door::scroll_region = false;
+
+  // Only the kept lines are output again.
+  log.append(*d, "four");
+  log.append(*d, "five");
+  d->debug_buffer.clear();
+  *d << log;
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[Hfour\x1b[2Hfive");
+  *d << door::reset;
+  d->debug_buffer.clear();
+
+  // Covered on a Screen, only the visible columns are output.
+  door::Screen screen;
+  std::unique_ptr<door::LogPanel> covered =
+      std::make_unique<door::LogPanel>(1, 1, 4, 2);
+  door::LogPanel *under = covered.get();
+  std::unique_ptr<door::Panel> popup = std::make_unique<door::Panel>(3, 2, 2);
+  popup->addLine(std::make_unique<door::Line>("XY", 2));
+  screen.addPanel(std::move(covered));
+  screen.addPanel(std::move(popup));
+  under->add("one");
+  *d << screen;
+  d->debug_buffer.clear();
+  door::scroll_region = true;
+  under->append(*d, "two");
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[Hone \x1b[2Htw");
+  door::scroll_region = false;
+  *d << door::reset;
+  d->debug_buffer.clear();
+
+  // No rows still shows (and keeps) one.
+  door::LogPanel tiny(1, 1, 4, 0);
+  tiny.add("one");
+  tiny.add("two");
+  *d << tiny;
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[Htwo ");
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, WrapPanel) {
+  door::WrapPanel text(1, 1, 10, 3);
+  text.addParagraph("|14The quick |12brown fox");
+  text.addParagraph("Jumped");
+  EXPECT_EQ(text.lineCount(), 3);
+
+  *d << door::reset;
+  d->debug_buffer.clear();
+  *d << text;
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[H\x1b[1;33mThe quick "
+               "\x1b[2H\x1b[31mbrown fox "
+               "\x1b[3H\x1b[0mJumped    ");
+  d->debug_buffer.clear();
+
+  // Long words are broken at the width.
+  text.setParagraph(1, "Overtheverylazydog");
+  text.setWidth(12);
+  EXPECT_EQ(text.lineCount(), 4);
+  EXPECT_TRUE(text.scroll(*d, 9));
+  EXPECT_EQ(text.getTop(), 1);
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[H\x1b[1;31mbrown fox   "
+               "\x1b[2H\x1b[0mOvertheveryl"
+               "\x1b[3Hazydog      ");
+  *d << door::reset;
+  d->debug_buffer.clear();
+
+  // The columns follow door::unicode, not what it was when it was set.
+  door::WrapPanel accents(1, 1, 11, 2);
+  accents.addParagraph("h\xc3\xa9llo w\xc3\xb6rld");
+  EXPECT_EQ(accents.lineCount(), 2);
+  door::unicode = true;
+  EXPECT_EQ(accents.lineCount(), 1);
+  door::unicode = false;
+  EXPECT_EQ(accents.lineCount(), 2);
+}
+
+TEST_F(DoorTest, MenuChoose) {
+  door::Menu menu(1, 1, 6);
+  menu.addSelection('A', "Apple");
+  menu.addSelection('B', "Bread");
+  menu.addSelection('C', "Cheese");
+
+  // The Gotos in the output
+  auto gotos = [](const std::string &out) -> std::string {
+    std::string found;
+    for (std::size_t pos = out.find("\x1b["); pos != std::string::npos;
+         pos = out.find("\x1b[", pos + 1)) {
+      std::size_t end = out.find_first_not_of("0123456789;", pos + 2);
+      if ((end != std::string::npos) and (out[end] == 'H'))
+        found += out.substr(pos, end + 1 - pos);
+    }
+    return found;
+  };
+
+  // The whole menu, then each key outputs two lines and the end Goto.
+  door::pushback.push_back('2');
+  door::pushback.push_back('c');
+  EXPECT_EQ(menu.choose(*d), 3);
+  EXPECT_EQ(gotos(d->debug_buffer),
+            "\x1b[H\x1b[2H\x1b[3H\x1b[4H\x1b[5H"
+            "\x1b[2;2H\x1b[3;2H\x1b[5;9H"
+            "\x1b[3;2H\x1b[4;2H\x1b[5;9H");
+  EXPECT_TRUE(door::pushback.empty());
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, MenuTypeAhead) {
+  door::PrefixIndex search;
+  search.add("Apple", 0);
+  search.add("Banana", 1);
+  search.add("Blueberry", 2);
+  search.reset();
+
+  // Each key narrows the range, backspace widens it again.
+  EXPECT_TRUE(search.narrow('b'));
+  EXPECT_EQ(search.matches(), 2u);
+  EXPECT_TRUE(search.narrow('L'));
+  EXPECT_EQ(search.match(), 2);
+  EXPECT_FALSE(search.narrow('x'));
+  search.back();
+  EXPECT_EQ(search.matches(), 2u);
+
+  // CP437 bytes (above 0x7f) are keys too.
+  door::PrefixIndex cp437;
+  cp437.add("\x8e" "rger", 0);
+  cp437.reset();
+  EXPECT_TRUE(cp437.narrow('\x8e'));
+
+  door::Menu menu(1, 1, 10);
+  menu.addSelection('1', "Apple");
+  menu.addSelection('2', "Banana");
+  menu.addSelection('3', "Blueberry");
+  door::pushback.push_back('b');
+  door::pushback.push_back('l');
+  door::pushback.push_back(0x0d);
+  EXPECT_EQ(menu.choose(*d), 3);
+  EXPECT_TRUE(door::pushback.empty());
+  *d << door::reset;
+  d->debug_buffer.clear();
+
+  // Space is typed once the search has started.
+  std::vector<std::string> names = {"Big Apple", "Big Banana", "Cherry"};
+  door::ListMenu list(
+      1, 1, 10, 3, [&names](void) -> int { return names.size(); },
+      [&names](int i) -> std::string { return names[i]; });
+  for (char c : std::string("big b\r"))
+    door::pushback.push_back(c);
+  EXPECT_EQ(list.choose(*d), 2);
+
+  // The index is built again when the items change.
+  names[2] = "Damson";
+  list.invalidate();
+  door::pushback.push_back('d');
+  door::pushback.push_back(0x0d);
+  EXPECT_EQ(list.choose(*d), 3);
+
+  // The selection stays in a shorter list, an empty list chooses nothing.
+  names.pop_back();
+  door::pushback.push_back(0x0d);
+  EXPECT_EQ(list.choose(*d), 2);
+  names.clear();
+  door::pushback.push_back(0x0d);
+  EXPECT_EQ(list.choose(*d), 0);
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, ObservableLine) {
+  door::Observable<int> gold(5);
+  door::Panel panel(1, 2, 8);
+  std::unique_ptr<door::Line> line = std::make_unique<door::Line>("", 8);
+  line->watch<int>(gold, [](const int &g) -> std::string {
+    return "Gold " + std::to_string(g);
+  });
+  EXPECT_STREQ(line->getText(), "Gold 5  ");
+  panel.addLine(std::move(line));
+
+  *d << panel;
+  d->debug_buffer.clear();
+  EXPECT_FALSE(panel.update(*d));
+
+  gold = 7;
+  EXPECT_TRUE(panel.update(*d));
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[2;6H7");
+  d->debug_buffer.clear();
+
+  // Setting the same value doesn't notify.
+  gold = 7;
+  EXPECT_FALSE(panel.update(*d));
+
+  // The subscription ends with the Line.
+  {
+    door::Observable<int> turns(1);
+    {
+      door::Line temp("", 0);
+      temp.watch<int>(turns, [](const int &t) { return std::to_string(t); });
+    }
+    turns = 2;
+  }
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, SharedLine) {
+  door::Observable<int> turns(10);
+  std::shared_ptr<door::Line> line = std::make_shared<door::Line>("", 8);
+  line->watch<int>(turns, [](const int &t) -> std::string {
+    return "Turns " + std::to_string(t);
+  });
+
+  door::Panel left(1, 1, 8);
+  door::Panel right(20, 5, 8);
+  left.addLine(line);
+  right.addLine(line);
+  *d << left << right;
+  d->debug_buffer.clear();
+
+  // Both placements are repainted by the first update.
+  turns = 11;
+  EXPECT_TRUE(left.update(*d));
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[;8H1\x1b[5;27H1");
+  d->debug_buffer.clear();
+  EXPECT_FALSE(right.update(*d));
+  EXPECT_TRUE(d->debug_buffer.empty());
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, MoveWithoutAllocating) {
+  EXPECT_TRUE(std::is_nothrow_move_constructible<door::Line>::value);
+  EXPECT_TRUE(std::is_nothrow_move_constructible<door::Panel>::value);
+  EXPECT_TRUE(std::is_nothrow_move_constructible<door::Menu>::value);
+
+  door::Line line(std::string(60, 'L'), 60, door::rBlueYellow);
+  line.setPadding("  padding that is not short  ", door::ANSIColor());
+  door::Panel panel(1, 1, 20);
+  panel.addLine(std::make_unique<door::Line>("A line in the panel", 20));
+  door::Menu menu(1, 1, 30);
+  menu.addSelection('A', "Alpha option with a long name");
+  menu.addSelection('B', "Beta option with a long name");
+
+  allocations = 0;
+  counting_allocations = true;
+  door::Line movedLine(std::move(line));
+  door::Panel movedPanel(std::move(panel));
+  door::Menu movedMenu(std::move(menu));
+  counting_allocations = false;
+
+  EXPECT_EQ(allocations, 0);
+  EXPECT_EQ(std::string(movedLine.getText()), std::string(60, 'L'));
+  EXPECT_EQ(movedMenu.which(1), 'B');
+}
+
+TEST_F(DoorTest, FrameArenaSteadyState) {
+  int score = 100;
+  door::updateFunction scoreText = [&score](void) -> std::string {
+    return "Score " + std::to_string(score);
+  };
+  door::Panel panel(1, 1, 40);
+  std::unique_ptr<door::Line> line =
+      std::make_unique<door::Line>(scoreText(), 40, door::rBlueYellow);
+  line->setUpdater(scoreText);
+  panel.addLine(std::move(line));
+  *d << panel;
+
+  // Warm up, so the arena and buffers have grown.
+  for (int i = 0; i < 3; ++i) {
+    ++score;
+    panel.update(*d);
+  }
+  d->debug_buffer.clear();
+  d->debug_buffer.reserve(1024);
+
+  allocations = 0;
+  counting_allocations = true;
+  ++score;
+  EXPECT_TRUE(panel.update(*d));
+  counting_allocations = false;
+  EXPECT_EQ(allocations, 0);
+  EXPECT_GT(door::frame_arena.capacity(), 0u);
+
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, RenderOutlivesFrame) {
+  std::unique_ptr<door::Render> kept;
+  {
+    door::FrameScope frame;
+    door::RenderRule rule;
+    rule.upper(door::ANSIColor(door::COLOR::RED));
+    door::Render r = rule("Kept");
+    kept = std::make_unique<door::Render>(std::move(r));
+  }
+  // Public Renders use the heap, even inside a FrameScope.
+  EXPECT_EQ(kept->getText().get_allocator().arena, nullptr);
+  EXPECT_EQ(kept->outputs.get_allocator().arena, nullptr);
+  EXPECT_EQ(kept->getText(), "Kept");
+}
+
+TEST_F(DoorTest, PackedPanel) {
+  door::PackedColor white(door::COLOR::WHITE, door::COLOR::BLACK);
+  door::PackedColor green(door::COLOR::GREEN, door::COLOR::BLACK);
+  door::PackedPanel panel(1, 1, 6, 2);
+  int digits = panel.addRule(door::RenderRule(white).digit(green));
+  panel.append("Al 10", white, digits);
+  panel.append("Bob", white);
+  panel.append("Carlos 7", white);
+
+  EXPECT_EQ(panel.size(), 3);
+  EXPECT_EQ(panel.widest(), 8);
+  EXPECT_EQ(panel.getHeight(), 2);
+
+  *d << panel;
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[HAl \x1b[32m10 \x1b[2H\x1b[37mBob   ");
+  d->debug_buffer.clear();
+
+  // Clipped to the width.
+  panel.scroll(5);
+  EXPECT_EQ(panel.getTop(), 1);
+  *d << panel;
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[HBob   \x1b[2HCarlos");
+  d->debug_buffer.clear();
+
+  panel.setText(1, "Bo");
+  EXPECT_TRUE(panel.update(*d));
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[HBo    ");
+  EXPECT_EQ(panel.getText(1), "Bo");
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+/// PackedPanel, with the pool size
+struct PackedPool : public door::PackedPanel {
+  using door::PackedPanel::PackedPanel;
+  std::size_t poolSize(void) const { return pool.size(); }
+};
+
+TEST_F(DoorTest, PackedPanelPool) {
+  PackedPool panel(1, 1, 6, 2);
+  panel.append("Score", door::PackedColor());
+  panel.append("99", door::PackedColor());
+
+  // A value flipping between two lengths keeps its slot.
+  panel.setText(1, "100");
+  std::size_t size = panel.poolSize();
+  for (int i = 0; i < 10; ++i) {
+    panel.setText(1, "99");
+    panel.setText(1, "100");
+  }
+  EXPECT_EQ(panel.poolSize(), size);
+
+  // Growing values don't grow the pool without bound.
+  for (int i = 0; i < 1000; ++i)
+    panel.setText(1, std::string(3 + i % 50, '9'));
+  EXPECT_LT(panel.poolSize(), 200u);
+  EXPECT_EQ(panel.getText(0), "Score");
+  EXPECT_EQ(panel.getText(1), std::string(3 + 999 % 50, '9'));
+}
+
+TEST_F(DoorTest, PanelBorder) {
+  door::Panel panel(1, 1, 3);
+  panel.setStyle(door::BorderStyle::SINGLE);
+  panel.setColor(door::ANSIColor(door::COLOR::WHITE));
+  panel.addLine(std::make_unique<door::Line>("abc", 3));
+  std::shared_ptr<door::Line> spacer = panel.spacer_line(false);
+  panel.addLine(spacer);
+  auto title = std::make_unique<door::Line>("T", 1);
+  door::Line *titleLine = title.get();
+  panel.setTitle(std::move(title), 1);
+
+  // Spacer lines join the border.
+  *d << panel;
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[H\xda\xc4T\xc4\xbf\x1b[2H\xb3"
+               "abc\xb3\x1b[3H\xc6\xcd\xcd\xcd\xb5"
+               "\x1b[4H\xc0\xc4\xc4\xc4\xd9");
+  d->debug_buffer.clear();
+
+  // The text no longer joins the border.
+  spacer->setText("xyz");
+  *d << panel;
+  EXPECT_NE(d->debug_buffer.find("\x1b[3H\xb3xyz\xb3"), std::string::npos);
+  d->debug_buffer.clear();
+
+  // The image shows the new title.
+  titleLine->setText("U");
+  *d << panel;
+  EXPECT_EQ(d->debug_buffer.find("\x1b[H\xda\xc4U\xc4\xbf"), 0u);
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
+TEST_F(DoorTest, ExtendedColors) {
+  door::ANSIColor orange(door::XColor(255, 128, 0), door::XColor(0, 0, 95));
+  EXPECT_EQ(orange.bg, door::COLOR::BLUE);
+  EXPECT_EQ(door::XColor(203).fg16(), 9); // bright red
+  EXPECT_EQ(door::XColor(244).bg8(), (int)door::COLOR::WHITE);
+
+  *d << door::ANSIColor(door::XColor(226));
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[1;33m");
+  *d << door::reset;
+  d->debug_buffer.clear();
+
+  door::color_depth = door::ColorDepth::TRUECOLOR;
+  *d << orange;
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[0;38;2;255;128;0;48;2;0;0;95m");
+  d->debug_buffer.clear();
+  *d << door::ANSIColor(door::COLOR::GREEN);
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[0;32;40m");
+  d->debug_buffer.clear();
+
+  // Render runs keep the extended colors.
+  door::RenderRule rule(door::ANSIColor(door::COLOR::WHITE));
+  rule.upper(door::ANSIColor(door::XColor(255, 128, 0)));
+  rule("Ab").output(*d);
+  EXPECT_EQ(d->debug_buffer.find("\x1b[0;38;2;255;128;0"), 0u);
+  EXPECT_NE(orange, door::ANSIColor(door::XColor(255, 128, 8),
+                                    door::XColor(0, 0, 95)));
+  *d << door::reset;
+  d->debug_buffer.clear();
+  door::color_depth = door::ColorDepth::ANSI_BBS;
+}
+
+TEST_F(DoorTest, ANSIArtDecode) {
+  door::ANSIArt art;
+  const char ans[] = "\x1b[1;31mAB\x1b[0m      C\r\n\x1b[44m \x1b[2;5HD";
+  art.decode(ans, sizeof(ans) - 1);
+  EXPECT_EQ(art.getHeight(), 2);
+  EXPECT_EQ(art.cell(0, 0).ch, 'A');
+  EXPECT_EQ(art.cell(0, 0).color,
+            door::PackedColor(door::COLOR::RED, door::COLOR::BLACK, true));
+  EXPECT_EQ(art.cell(0, 1).color.bg(), door::COLOR::BLUE);
+  EXPECT_EQ(art.cell(4, 1).ch, 'D');
+
+  *d << door::reset;
+  d->debug_buffer.clear();
+  *d << art;
+  EXPECT_STREQ(d->debug_buffer.c_str(), "\x1b[H\x1b[1;31mAB\x1b[6C\x1b[0mC"
+                                        "\x1b[2H\x1b[44m \x1b[3CD");
+  d->debug_buffer.clear();
+
+  // Huge parameters are clamped, and so is the height.
+  door::ANSIArt hostile;
+  const char huge[] = "\x1b[99999999999999999999;5HX";
+  hostile.decode(huge, sizeof(huge) - 1);
+  EXPECT_EQ(hostile.getHeight(), 9999);
+  EXPECT_EQ(hostile.cell(4, 9998).ch, 'X');
+}
+
+TEST_F(DoorTest, FileViewer) {
+  char name[] = "/tmp/test-doorXXXXXX";
+  int fd = mkstemp(name);
+  ASSERT_NE(fd, -1);
+  const char text[] = "\x1b[31mone\r\ntwo\n\tx\nfour\nfive";
+  ASSERT_EQ(write(fd, text, sizeof(text) - 1), (ssize_t)sizeof(text) - 1);
+  close(fd);
+
+  door::FileViewer viewer(1, 1, 4, 2);
+  EXPECT_TRUE(viewer.load(name));
+  *d << door::reset;
+  d->debug_buffer.clear();
+
+  // The color carries on to the next line.
+  *d << viewer;
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[H\x1b[31mone\x1b[37m \x1b[2H\x1b[31mtwo\x1b[37m ");
+  d->debug_buffer.clear();
+
+  // Tabs are expanded, and the page stops at the end of the file.
+  EXPECT_TRUE(viewer.scroll(*d, 2));
+  EXPECT_STREQ(d->debug_buffer.c_str(),
+               "\x1b[H\x1b[31m    \x1b[2Hfour");
+  d->debug_buffer.clear();
+  EXPECT_TRUE(viewer.scroll(*d, 99));
+  EXPECT_EQ(viewer.getTop(), 3);
+  EXPECT_EQ(viewer.lineCount(), 5);
+  unlink(name);
+  *d << door::reset;
+  d->debug_buffer.clear();
+
+  // Long lines wrap at 80 columns, cursor forward is blank columns, and
+  // control codes aren't sent.
+  char wideName[] = "/tmp/test-doorXXXXXX";
+  fd = mkstemp(wideName);
+  ASSERT_NE(fd, -1);
+  std::string wide = std::string(82, 'x') + "\r\n\x1b[2Cb\x07";
+  ASSERT_EQ(write(fd, wide.data(), wide.length()), (ssize_t)wide.length());
+  close(fd);
+  door::FileViewer wrapped(1, 1, 4, 3);
+  EXPECT_TRUE(wrapped.load(wideName));
+  EXPECT_EQ(wrapped.lineCount(), 3);
+  *d << wrapped;
+  EXPECT_NE(d->debug_buffer.find("\x1b[2Hxx  \x1b[3H  b "), std::string::npos);
+  EXPECT_EQ(d->debug_buffer.find('\x07'), std::string::npos);
+  unlink(wideName);
+  *d << door::reset;
+  d->debug_buffer.clear();
+}
+
 TEST_F(DoorTest, ResetOutput) {
   *d << door::reset;
 